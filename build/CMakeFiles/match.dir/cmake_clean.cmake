@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/match.dir/src/match.cc.o"
+  "CMakeFiles/match.dir/src/match.cc.o.d"
+  "match"
+  "match.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/match.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -11,4 +11,47 @@ bits=15
 ./build/match -v -b ${bits} -t the_quick_the_round_fox_the_round
 ./build/match -v -b ${bits} -t foo_ate_foo_bar_baz_bar_ate_foo
 ./build/match -v -b ${bits} -t foo_ate_foo_bar_baz_bar_ate_bar
-./build/match -v -b ${bits} -t TGGGCGTGCGCTTGAAAAGAGCCTAAGAAGAGGGGGCGTCTGGAAGGAACCGCAACGCCAAGGGAGGGTG
\ No newline at end of file
+./build/match -v -b ${bits} -t TGGGCGTGCGCTTGAAAAGAGCCTAAGAAGAGGGGGCGTCTGGAAGGAACCGCAACGCCAAGGGAGGGTG
+./build/match -v -b ${bits} -k -s _ -t the_quick_the_round_fox_the_quick_the_round_fox
+./build/match -v -b ${bits} -l -w 2 -t $'GET /a 200 user=alice\nGET /a 200 user=bob\nPOST /b 404 user=alice\n'
+./build/match -v -b ${bits} -j 2 -c , -t $'id,host,status\n1,web01,ok\n2,web01,ok\n3,"web02, east",fail\n4,web01,ok\n'
+./build/match -v -b ${bits} -n -t TGGGCGTGCGCTTGAAAAGAGCCTAAGAAGAGGGGGCGTCTGGAAGGAACCGCAACGCCAAGGGAGGGTGNNNNTGGGCGTGCGCTTGAAAAGAGCCTAAGAAGAGGGGGCGTCTGGAAGGAACCGCAACGCCAAGG
+./build/match -v -d -b ${bits} -n -r -t TGGGCGTGCGCTTGAAAAGAGCCTAAgaagagggggcgtctggaaggaaccgcAACGCCAAGGNNNNtgggcgtgcgcttgaaaagagcctaagaagagggggcgtctggaaggaaccgcaacgcc
+./build/match -v -d -b ${bits} -n -r -t GATTACAGGCCTTAAGCATTTTGCTTAAGGCCTGTAATC
+./build/match -v -b ${bits} -n -a <(printf '>chr1 test\nGATTACAGGCCTTAAG\nCATTTTGATTACA\n>chr2\nGGCCTTAAGCATTTTNNNN\n')
+./build/match -v -b ${bits} -n -a <(printf '@read1\nGATTACAGGCCTTAAG\n+\n@@@@IIIIIIIIIIII\n@read2\nCCTTAAGGATTACA\n+read2\nIIIIIIIIIIIIII\n')
+./build/match -v -d -b ${bits} -m 4,8 -t the_quick_brown_fox_jumps_over_the_lazy_dog_the_quick_brown_fox_jumps_over_the_lazy_cat
+./build/match -v -d -b ${bits} -i 4 -C -t the_quick_brown_fox_jumps_over_the_lazy_dog_the_quick_brown_fox_jumps_over_the_lazy_cat
+./build/match -v -d -b ${bits} -I all -t abcdefgh_abcdefgh_cdefg
+./build/match -d -b ${bits} -w 64 -t tixlzwxuqaoyhubfdlphmrdshaxgnifymfyzcettoeeaagygffjkgrvugfwgmjalnfeickjtsatvwkcjljpwkfppwfbiaxlmarzn_zscpyibaevspyxlkyaipzgxnrrvdgsrwzxivztvcnkclznziowdygwuzjdbsgulpgqsuwzqaulhtnjlsdcqvqgdtvijxgmphetgwqagyfaukrvttjlmqmjevpbfntxmdohzctvoozmzcqnpjwncgxviopxzfaardiszlgiqokqinntpitpvppexmpjuzoklvftmwtiku_tixlzwxuqaoyhubfdlphmrdshaxgnifymfyzcettoeeaagygffjkgrvugfwgmjalnfeickjtsatvwkcjljpwkfppwfbiaxlmarzn
+./build/match -d -b ${bits} -w 64 -L 64,2 -t tixlzwxuqaoyhubfdlphmrdshaxgnifymfyzcettoeeaagygffjkgrvugfwgmjalnfeickjtsatvwkcjljpwkfppwfbiaxlmarzn_zscpyibaevspyxlkyaipzgxnrrvdgsrwzxivztvcnkclznziowdygwuzjdbsgulpgqsuwzqaulhtnjlsdcqvqgdtvijxgmphetgwqagyfaukrvttjlmqmjevpbfntxmdohzctvoozmzcqnpjwncgxviopxzfaardiszlgiqokqinntpitpvppexmpjuzoklvftmwtiku_tixlzwxuqaoyhubfdlphmrdshaxgnifymfyzcettoeeaagygffjkgrvugfwgmjalnfeickjtsatvwkcjljpwkfppwfbiaxlmarzn
+./build/match -d -b ${bits} -r -L 16,1 -t TACTATGCACTAAACTCTAGGCTCCCCAGACTCGCCGTAAATGAGGATGTTCGCACCAGATACGCCGATGTTAGTGGGGTCCACCCCCCATATCTGGTGCGAACATCCTCATTTACGGCGAGTCTGGGGAGCCTAGAGTTTAGTGCATAGTAGCACATAGTGACTGCTAGCGCATCGGCGTATCTGGTGCGAACATCCTCATTTACGGCGAGTCTGGGGAGCCTAGAGTTTAGTGCATAGTAGGGAACGAAA
+dir=$(mktemp -d); seq 1 20000 > ${dir}/a; cp ${dir}/a ${dir}/b; seq 5000 30000 > ${dir}/c
+./build/match -D ${dir} -S 1024; rm -rf ${dir}
+dir=$(mktemp -d); seq 1 20000 > ${dir}/old; (seq 1 9000; echo changed; seq 9001 20000) > ${dir}/new
+./build/match -G ${dir}/old -B 1024 > ${dir}/sig; ./build/match -v -R ${dir}/sig ${dir}/new; rm -rf ${dir}
+./build/match -v -d -b ${bits} -x 0.25 -t ptr=0x1000,ptr=0x1004,ptr=0x1008,ptr=0x100c,ptr=0x1010,ptr=0x1014,ptr=0x1018,ptr=0x101c
+./build/match -v -d -b ${bits} -r -x 0.25 -t AGATTTTCATATTATGCAGAAAATCTACTTCGCCTGATACGAGTCGGTTATCTTAAGATAACAGACTCCCACCTGCAATCGTAAGATAACACACTGAAACCTGCACGCCCACCTGCAATCGTATCCTGCATAAGATGAAAGTATTATCTTACGATTTAT
+dir=$(mktemp -d); seq 1 20000 > ${dir}/a; seq 15000 40000 > ${dir}/b; (seq 1 9000; echo changed; seq 9001 30000) > ${dir}/new
+./build/match -v -d -j 2 -e ${dir}/a -e ${dir}/b -f ${dir}/new; rm -rf ${dir}
+dir=$(mktemp -d); printf %s CCGTAATGCCTTTCCCTAACAGAGTTTTTCGAACTCGTGTTGTCGAGC > ${dir}/a; printf %s GACGGAATTAGATCAGTTAAATGGCAGAAAACTGGCAGGGCTTTTAGT > ${dir}/b; (cut -c 21-48 ${dir}/a; cut -c 1-36 ${dir}/b) | tr -d '\n' | rev | tr ACGT TGCA > ${dir}/new
+./build/match -v -d -b ${bits} -r -e ${dir}/a -e ${dir}/b -f ${dir}/new; rm -rf ${dir}
+dir=$(mktemp -d); for i in $(seq 1 40); do seq $i $((i+200)) | tr '\n' ' '; echo; done > ${dir}/docs
+./build/match -v -d -b ${bits} -V 4000 -f ${dir}/docs; rm -rf ${dir}
+./build/match -v -d -b ${bits} -E 10,4,GGGG -E 0,3 -E 40,0,TTAGGC -t TGGGCGTGCGCTTGAAAAGAGCCTAAGAAGAGGGGGCGTCTGGAAGGAACCGCAACGCCAAGGGAGGGTG
+dir=$(mktemp -d); seq 1 3000 > ${dir}/log; ./build/match -d -b ${bits} -w 4096 -F ${dir}/log & pid=$!
+sleep 0.2; for i in 1 2 3; do seq 1000 4000 >> ${dir}/log; sleep 0.05; done; rm ${dir}/log; wait ${pid}; rm -rf ${dir}
+dir=$(mktemp -d); seq 1 2000 > ${dir}/a; (seq 1 900; echo changed; seq 901 1500) > ${dir}/new
+./build/match -j 2 -e ${dir}/a -P ${dir}/sock & pid=$!; sleep 0.2
+./build/match -d -e ${dir}/a -K ${dir}/sock -f ${dir}/new; ./build/match -v -d -e ${dir}/a -K ${dir}/sock -t 'hello 1234 hello 1234'
+kill ${pid}; wait ${pid} 2>/dev/null; rm -rf ${dir}
+./build/match -v -d -A -B 16 -t the_quick_brown_fox_jumps_over_the_lazy_dog_the_quick_brown_fox_jumps_over_the_lazy_cat
+dir=$(mktemp -d); seq 1 200000 > ${dir}/a; ./build/match -d -b ${bits} -o ${dir}/a.edits -f ${dir}/a; rm -rf ${dir}
+dir=$(mktemp -d); for i in 1 2 3 4; do seq $i 5000 > ${dir}/f$i; done; seq 1 40000 > ${dir}/big
+./build/match -d -b ${bits} -j 3 -g 65536 ${dir} ${dir}/f1; rm -rf ${dir}
+./build/match -v -d -b ${bits} -y -j 3 -t the_quick_brown_fox_jumps_over_the_lazy_dog_the_quick_brown_fox_jumps_over_the_lazy_cat
+dir=$(mktemp -d); seq 1 20000 > ${dir}/a; ./build/match -d -b ${bits} -Y -j 4 -f ${dir}/a; rm -rf ${dir}
+dir=$(mktemp -d); seq 1 100000 > ${dir}/a; ./build/match -d -b ${bits} -j 2 -g 65536 -O ${dir}/a.mct -f ${dir}/a
+./build/match -X ${dir}/a.mct -Q 100000,100040; echo; rm -rf ${dir}
+./build/match -v -d -b ${bits} -x 0.25 -Q 20,60 -t ptr=0x1000,ptr=0x1004,ptr=0x1008,ptr=0x100c,ptr=0x1010,ptr=0x1014,ptr=0x1018,ptr=0x101c
+./build/match -v -d -b ${bits} -n -r -Q 20,39 -t GATTACAGGCCTTAAGCATTTTGCTTAAGGCCTGTAATC
@@ -0,0 +1,221 @@
+/*
+ * Access
+ *
+ * Random access decoding of byte ranges from an edit list.
+ *
+ * Copyright (c) 2020, Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+#include "matcher.h"
+
+/**
+ * random access decoder.
+ *
+ * An interval index of the output position of each instruction finds
+ * the instruction covering any position by binary search. A range is
+ * resolved with an explicit stack of pieces, each a run of output
+ * positions and where its symbols go. Literal pieces are read from the
+ * source, and copy pieces are mapped back to their source positions and
+ * pushed again, so only the instructions the range depends on are
+ * visited and the output is never decoded as a whole.
+ *
+ * A copy that overlaps its own output repeats with its distance, so a
+ * position inside it maps directly to its first period rather than
+ * stepping back one period at a time. Reverse complement and
+ * approximate copies record a complement or delta to apply once the
+ * inner symbols are known. Checkpoints keep decoded spans of the output,
+ * such as the sources of many copies, which end the resolution of any
+ * piece that falls inside them.
+ */
+template <typename Symbol, typename Source, typename Size>
+struct RangeDecoder
+{
+    struct Piece
+    {
+        size_t dst;                 /* out index of the first symbol */
+        ptrdiff_t step;             /* out index step for each symbol */
+        size_t src;                 /* output position of the first symbol */
+        size_t length;
+    };
+
+    struct Op
+    {
+        size_t dst;
+        ptrdiff_t step;
+        size_t length;
+        size_t delta;               /* delta index, or npos to complement */
+    };
+
+    struct Checkpoint
+    {
+        size_t offset;
+        Vector<Symbol> symbols;
+    };
+
+    static const size_t npos = size_t(-1);
+
+    const Vector<Match<Size>> &matches;
+    const Source &source;
+    const Vector<Symbol> *deltas;
+    Vector<size_t> starts;
+    Vector<size_t> delta_start;
+    Vector<Checkpoint> checkpoints;
+
+    RangeDecoder(const Vector<Match<Size>> &matches, const Source &source,
+        const Vector<Symbol> *deltas = nullptr);
+
+    size_t size() const { return starts.back(); }
+
+    void read(size_t begin, size_t end, Vector<Symbol> &out) const;
+    void checkpoint(size_t begin, size_t end);
+    void add_checkpoints(size_t stride, size_t length);
+};
+
+/** build the interval index of instruction output positions. */
+template <typename Symbol, typename Source, typename Size>
+RangeDecoder<Symbol,Source,Size>::RangeDecoder(
+    const Vector<Match<Size>> &matches, const Source &source,
+    const Vector<Symbol> *deltas) : matches(matches), source(source),
+    deltas(deltas), starts(), delta_start(), checkpoints()
+{
+    size_t pos = 0, d = 0;
+    starts.reserve(matches.size() + 1);
+    delta_start.reserve(matches.size());
+    for (auto &n : matches) {
+        starts.push_back(pos);
+        delta_start.push_back(d);
+        pos += n.length;
+        if (n.type == MatchType::Approx) d += n.length;
+    }
+    starts.push_back(pos);
+}
+
+/** decode output positions [begin,end) into out. */
+template <typename Symbol, typename Source, typename Size>
+void RangeDecoder<Symbol,Source,Size>::read(size_t begin, size_t end,
+    Vector<Symbol> &out) const
+{
+    end = std::min(end, size());
+    begin = std::min(begin, end);
+    out.assign(end - begin, Symbol());
+
+    Vector<Piece> stack;
+    Vector<Op> ops;
+    if (end > begin) stack.push_back({ 0, 1, begin, end - begin });
+
+    while (stack.size() > 0)
+    {
+        Piece p = stack.back();
+        stack.pop_back();
+
+        /* a checkpoint covering the start of the piece ends it */
+        auto c = std::upper_bound(checkpoints.begin(), checkpoints.end(),
+            p.src, [](size_t v, const Checkpoint &c) { return v < c.offset; });
+        if (c != checkpoints.begin() &&
+            (c - 1)->offset + (c - 1)->symbols.size() > p.src) {
+            c--;
+            size_t j = p.src - c->offset;
+            size_t n = std::min(p.length, c->symbols.size() - j);
+            for (size_t i = 0; i < n; i++) {
+                out[p.dst + p.step * i] = c->symbols[j + i];
+            }
+            if (p.length > n) {
+                stack.push_back({ p.dst + p.step * n, p.step, p.src + n,
+                    p.length - n });
+            }
+            continue;
+        }
+
+        /* split the piece at the end of the instruction containing it */
+        size_t k = std::upper_bound(starts.begin(), starts.end(), p.src) -
+            starts.begin() - 1;
+        const Match<Size> &m = matches[k];
+        size_t j = p.src - starts[k];
+        size_t n = std::min(p.length, starts[k + 1] - p.src);
+        if (p.length > n) {
+            stack.push_back({ p.dst + p.step * n, p.step, p.src + n,
+                p.length - n });
+        }
+
+        switch (m.type) {
+        case MatchType::Literal:
+            for (size_t i = 0; i < n; i++) {
+                out[p.dst + p.step * i] = Symbol(source[m.offset + j + i]);
+            }
+            break;
+        case MatchType::Copy: {
+            /* map overlapping copies into their first period */
+            size_t dist = starts[k] - m.offset;
+            while (n > 0) {
+                size_t jj = j % dist, r = std::min(n, dist - jj);
+                stack.push_back({ p.dst, p.step, m.offset + jj, r });
+                p.dst += p.step * r;
+                j += r;
+                n -= r;
+            }
+            break;
+        }
+        case MatchType::RevComp:
+            /* the piece reads its source backwards from the end */
+            ops.push_back({ p.dst, p.step, n, npos });
+            stack.push_back({ p.dst + p.step * (n - 1), -p.step,
+                m.offset + m.length - j - n, n });
+            break;
+        case MatchType::Approx:
+            assert(deltas);
+            ops.push_back({ p.dst, p.step, n, delta_start[k] + j });
+            stack.push_back({ p.dst, p.step, m.offset + j, n });
+            break;
+        }
+    }
+
+    /* ops found later are nearer the literals, so apply them first */
+    for (size_t o = ops.size(); o > 0; o--) {
+        const Op &op = ops[o - 1];
+        for (size_t i = 0; i < op.length; i++) {
+            Symbol &s = out[op.dst + op.step * i];
+            s = op.delta == npos ? complement(s) :
+                symbol_add(s, (*deltas)[op.delta + i]);
+        }
+    }
+}
+
+/** keep the decoded symbols of [begin,end) to shortcut later reads. */
+template <typename Symbol, typename Source, typename Size>
+void RangeDecoder<Symbol,Source,Size>::checkpoint(size_t begin, size_t end)
+{
+    Checkpoint c = { begin, Vector<Symbol>() };
+    read(begin, end, c.symbols);
+    if (c.symbols.empty()) return;
+    auto i = std::upper_bound(checkpoints.begin(), checkpoints.end(),
+        begin, [](size_t v, const Checkpoint &c) { return v < c.offset; });
+    checkpoints.insert(i, std::move(c));
+}
+
+/** keep length symbols at every stride of the output. */
+template <typename Symbol, typename Source, typename Size>
+void RangeDecoder<Symbol,Source,Size>::add_checkpoints(size_t stride,
+    size_t length)
+{
+    for (size_t pos = 0; pos < size(); pos += stride) {
+        checkpoint(pos, pos + length);
+    }
+}
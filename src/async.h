@@ -0,0 +1,210 @@
+/*
+ * Async
+ *
+ * Matcher with decomposition on a background worker thread.
+ *
+ * Copyright (c) 2020, Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "matcher.h"
+
+/**
+ * matcher decomposing on a background worker.
+ *
+ * The producer copies each append into a block and links it onto a
+ * single producer single consumer list, then publishes the new total
+ * size with a release store. The worker moves published blocks into the
+ * matcher and decomposes from mark to the end, so the producer never
+ * waits on matching and never touches the matcher. Progress is published
+ * in decomposed, and until returns a future that becomes ready once an
+ * offset has been decomposed. matches and data may be read after finish.
+ *
+ * Copies at the end of a batch stop at the data available, as when
+ * decompose is called after each append.
+ */
+template <typename Symbol = char, typename Size = uint32_t>
+struct AsyncMatcher
+{
+    struct Block
+    {
+        std::atomic<Block*> next;
+        Vector<Symbol> symbols;
+
+        Block() : next(nullptr), symbols() {}
+    };
+
+    struct Waiter
+    {
+        size_t offset;
+        std::promise<void> done;
+    };
+
+    Matcher<Symbol,Size> m;
+
+    Block *first;                       /* consumed, owned by the worker */
+    Block *last;                        /* newest, owned by the producer */
+    size_t appended;                    /* producer only */
+    std::atomic<size_t> published;
+    std::atomic<size_t> decomposed;
+    std::atomic<bool> closed;
+    std::atomic<bool> idle;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    Vector<Waiter> waiters;
+    std::thread worker;
+
+    AsyncMatcher(size_t hash_bits = Matcher<Symbol,Size>::kInitialHashBits);
+    ~AsyncMatcher();
+
+    void start();
+    void finish();
+
+    template <typename Iterator>
+    void append(Iterator begin, Iterator end);
+
+    std::future<void> until(size_t offset);
+
+    void run();
+    void notify(size_t offset);
+};
+
+template <typename Symbol, typename Size>
+AsyncMatcher<Symbol,Size>::AsyncMatcher(size_t hash_bits) : m(hash_bits),
+    first(new Block()), last(first), appended(0), published(0),
+    decomposed(0), closed(false), idle(false), lock(), wake(), waiters(),
+    worker() {}
+
+template <typename Symbol, typename Size>
+AsyncMatcher<Symbol,Size>::~AsyncMatcher()
+{
+    finish();
+    while (first) {
+        Block *next = first->next.load();
+        delete first;
+        first = next;
+    }
+}
+
+/** start the worker, after the matcher has been configured. */
+template <typename Symbol, typename Size>
+void AsyncMatcher<Symbol,Size>::start()
+{
+    worker = std::thread([this]() { run(); });
+}
+
+/** decompose everything appended and stop the worker. */
+template <typename Symbol, typename Size>
+void AsyncMatcher<Symbol,Size>::finish()
+{
+    if (!worker.joinable()) return;
+    closed.store(true, std::memory_order_release);
+    wake.notify_one();
+    worker.join();
+}
+
+/** append symbols from the producer thread without waiting. */
+template <typename Symbol, typename Size>
+template <typename Iterator>
+void AsyncMatcher<Symbol,Size>::append(Iterator begin, Iterator end)
+{
+    Block *b = new Block();
+    for (Iterator i = begin; i != end; i++) b->symbols.push_back(Symbol(*i));
+    appended += b->symbols.size();
+    last->next.store(b, std::memory_order_release);
+    last = b;
+    published.store(appended, std::memory_order_release);
+
+    /* only a worker that ran out of data needs waking */
+    if (idle.load(std::memory_order_acquire)) wake.notify_one();
+}
+
+/** return a future that is ready once offset has been decomposed. */
+template <typename Symbol, typename Size>
+std::future<void> AsyncMatcher<Symbol,Size>::until(size_t offset)
+{
+    std::unique_lock<std::mutex> l(lock);
+    waiters.push_back(Waiter{ offset, std::promise<void>() });
+    std::future<void> f = waiters.back().done.get_future();
+    if (decomposed.load(std::memory_order_acquire) >= offset) {
+        waiters.back().done.set_value();
+        waiters.pop_back();
+    }
+    return f;
+}
+
+/** complete the futures of waiters at or before offset. */
+template <typename Symbol, typename Size>
+void AsyncMatcher<Symbol,Size>::notify(size_t offset)
+{
+    std::unique_lock<std::mutex> l(lock);
+    decomposed.store(offset, std::memory_order_release);
+    size_t j = 0;
+    for (size_t i = 0; i < waiters.size(); i++) {
+        if (waiters[i].offset <= offset) {
+            waiters[i].done.set_value();
+        } else {
+            if (i != j) waiters[j] = std::move(waiters[i]);
+            j++;
+        }
+    }
+    waiters.resize(j);
+}
+
+/** worker loop moving published blocks into the matcher. */
+template <typename Symbol, typename Size>
+void AsyncMatcher<Symbol,Size>::run()
+{
+    for (;;) {
+        /* read closed first so no append published before it is missed */
+        bool done = closed.load(std::memory_order_acquire);
+        size_t size = published.load(std::memory_order_acquire);
+
+        if (size > m.data.size()) {
+            idle.store(false, std::memory_order_relaxed);
+            while (m.data.size() < size) {
+                Block *next = first->next.load(std::memory_order_acquire);
+                delete first;
+                first = next;
+                m.append(first->symbols.begin(), first->symbols.end());
+                Vector<Symbol>().swap(first->symbols);
+            }
+            m.decompose(false);
+            notify(m.mark);
+            continue;
+        }
+        if (done) break;
+
+        /* sleep until woken, rechecking in case a wakeup raced the flag */
+        std::unique_lock<std::mutex> l(lock);
+        idle.store(true, std::memory_order_release);
+        if (published.load(std::memory_order_acquire) == m.data.size() &&
+            !closed.load(std::memory_order_acquire)) {
+            wake.wait_for(l, std::chrono::milliseconds(1));
+        }
+    }
+    idle.store(false, std::memory_order_relaxed);
+}
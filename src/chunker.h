@@ -0,0 +1,192 @@
+/*
+ * Chunker
+ *
+ * Content defined chunking and chunk level deduplication.
+ *
+ * Copyright (c) 2020, Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "matcher.h"
+
+/**
+ * FastCDC content defined chunker.
+ *
+ * Cut points are found with a gear hash, using a stricter mask before the
+ * average chunk size and a looser one after it to normalize chunk sizes.
+ * The hash is rolled two bytes per step with a pre-shifted gear table and
+ * pre-shifted masks, so each byte costs a single add and shift.
+ */
+struct Chunker
+{
+    size_t min_size;
+    size_t avg_size;
+    size_t max_size;
+    uint64_t mask_s, mask_l;
+    uint64_t gear_ls[256];
+
+    Chunker(size_t avg_size = 8192);
+
+    size_t cut(const uint8_t *src, size_t length);
+
+    static uint64_t spread_mask(size_t bits);
+};
+
+/** spread mask bits over the high half of the hash, below the top bit. */
+inline uint64_t Chunker::spread_mask(size_t bits)
+{
+    uint64_t mask = 0;
+    for (size_t i = 0; i < bits; i++) {
+        mask |= 1ull << (62 - (i * 31) / bits);
+    }
+    return mask;
+}
+
+inline Chunker::Chunker(size_t avg_size) : min_size(avg_size / 4),
+    avg_size(avg_size), max_size(avg_size * 8)
+{
+    size_t bits = 0;
+    while ((size_t(1) << (bits + 1)) <= avg_size) bits++;
+    mask_s = spread_mask(bits + 2);
+    mask_l = spread_mask(bits > 2 ? bits - 2 : 1);
+
+    const uint64_t *gear = gear_table();
+    for (size_t i = 0; i < 256; i++) gear_ls[i] = gear[i] << 1;
+}
+
+/** return the length of the next chunk starting at src. */
+inline size_t Chunker::cut(const uint8_t *src, size_t length)
+{
+    if (length <= min_size) return length;
+
+    const uint64_t *gear = gear_table();
+    uint64_t fp = 0, mask_s_ls = mask_s << 1, mask_l_ls = mask_l << 1;
+    size_t n = std::min(length, max_size), normal = std::min(n, avg_size);
+    size_t i = min_size;
+
+    /* the odd byte uses the pre-shifted table and masks */
+    for (; i + 1 < normal; i += 2) {
+        fp = (fp << 2) + gear_ls[src[i]];
+        if (!(fp & mask_s_ls)) return i;
+        fp += gear[src[i + 1]];
+        if (!(fp & mask_s)) return i + 1;
+    }
+    for (; i + 1 < n; i += 2) {
+        fp = (fp << 2) + gear_ls[src[i]];
+        if (!(fp & mask_l_ls)) return i;
+        fp += gear[src[i + 1]];
+        if (!(fp & mask_l)) return i + 1;
+    }
+    return n;
+}
+
+/** 64-bit chunk fingerprint reading eight bytes at a time. */
+static inline uint64_t chunk_fingerprint(const uint8_t *src, size_t length)
+{
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ length;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t v;
+        memcpy(&v, src + i, 8);
+        h = hash_mix(h ^ v);
+    }
+    uint64_t v = 0;
+    memcpy(&v, src + i, length - i);
+    return hash_mix(h ^ v ^ (uint64_t(length - i) << 56));
+}
+
+/**
+ * chunk level deduplication store.
+ *
+ * Unique chunks are stored once and files are described by a list of
+ * chunk references. Fingerprints index the chunks in an open addressing
+ * table and hits are compared byte for byte, so a fingerprint collision
+ * never merges different chunks.
+ */
+struct DedupeStore
+{
+    struct Chunk { uint64_t fingerprint; size_t offset; size_t length; };
+
+    Chunker chunker;
+    Vector<uint8_t> store;
+    Vector<Chunk> chunks;
+    Vector<uint32_t> slots;     /* chunk id + 1, zero is empty */
+    size_t total_bytes = 0;
+    size_t total_chunks = 0;
+
+    DedupeStore(size_t avg_size = 8192) : chunker(avg_size), store(),
+        chunks(), slots(1024) {}
+
+    uint32_t intern(const uint8_t *src, size_t length);
+    void add(const uint8_t *src, size_t length, Vector<uint32_t> &refs);
+    void grow();
+};
+
+/** double the slot table and reinsert chunk ids. */
+inline void DedupeStore::grow()
+{
+    Vector<uint32_t> old(slots.size() << 1);
+    std::swap(slots, old);
+    size_t mask = slots.size() - 1;
+    for (uint32_t id = 0; id < chunks.size(); id++) {
+        size_t i = chunks[id].fingerprint & mask;
+        while (slots[i]) i = (i + 1) & mask;
+        slots[i] = id + 1;
+    }
+}
+
+/** return the id of a chunk, storing it if it has not been seen. */
+inline uint32_t DedupeStore::intern(const uint8_t *src, size_t length)
+{
+    if ((chunks.size() + 1) * 2 > slots.size()) grow();
+
+    uint64_t fp = chunk_fingerprint(src, length);
+    size_t mask = slots.size() - 1;
+    size_t i = fp & mask;
+    while (slots[i]) {
+        const Chunk &c = chunks[slots[i] - 1];
+        if (c.fingerprint == fp && c.length == length &&
+            memcmp(&store[c.offset], src, length) == 0) {
+            return slots[i] - 1;
+        }
+        i = (i + 1) & mask;
+    }
+
+    uint32_t id = uint32_t(chunks.size());
+    slots[i] = id + 1;
+    chunks.push_back({ fp, store.size(), length });
+    store.insert(store.end(), src, src + length);
+    return id;
+}
+
+/** split data into chunks and append their references. */
+inline void DedupeStore::add(const uint8_t *src, size_t length,
+    Vector<uint32_t> &refs)
+{
+    total_bytes += length;
+    while (length > 0) {
+        size_t n = chunker.cut(src, length);
+        refs.push_back(intern(src, n));
+        total_chunks++;
+        src += n;
+        length -= n;
+    }
+}
@@ -0,0 +1,222 @@
+/*
+ * Container
+ *
+ * Block independent container of edit lists with a seek index.
+ *
+ * Copyright (c) 2020, Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include "matcher.h"
+#include "encoding.h"
+
+/**
+ * block independent container.
+ *
+ * The input is cut into fixed size blocks and each block is matched by
+ * a matcher rewound to empty, so its copies never refer outside it. A
+ * block is stored as its instructions from encode_matches followed by
+ * its literal symbols. The blocks are followed by an index of the input
+ * and encoded offset of each block and a footer locating the index, so
+ * blocks can be encoded and decoded in parallel and a byte range only
+ * needs the blocks that cover it.
+ *
+ * - header: magic, block size
+ * - blocks: encoded instructions, literal symbols
+ * - index: input offset, encoded offset, encoded length per block
+ * - footer: input length, block count, index offset, magic
+ *
+ * Integers in the header, index and footer are little-endian 64-bit.
+ */
+struct Container
+{
+    static const uint64_t kMagic = 0x5254434d; /* "MCTR" */
+
+    struct Entry
+    {
+        uint64_t offset;
+        uint64_t encoded;
+        uint64_t length;
+    };
+
+    int fd;
+    uint64_t block_size;
+    uint64_t length;
+    Vector<Entry> index;
+
+    Container() : fd(-1), block_size(0), length(0), index() {}
+
+    template <typename Init>
+    static bool write(FILE *f, const uint8_t *src, size_t length,
+        size_t block_size, size_t threads, Init init);
+
+    bool open(int fd);
+    bool read_block(size_t i, Vector<char> &out) const;
+    bool read(size_t threads, Vector<char> &out) const;
+    bool read_range(size_t begin, size_t end, Vector<char> &out) const;
+};
+
+/** match blocks in parallel with one matcher per thread and write them. */
+template <typename Init>
+bool Container::write(FILE *f, const uint8_t *src, size_t length,
+    size_t block_size, size_t threads, Init init)
+{
+    size_t count = (length + block_size - 1) / block_size;
+    Vector<Vector<uint8_t>> blocks(count);
+    std::atomic<size_t> next(0);
+
+    auto worker = [&]() {
+        Matcher<> m;
+        init(m);
+        const Vector<uint32_t> empty;
+        size_t b;
+        while ((b = next++) < count) {
+            size_t begin = b * block_size;
+            size_t end = std::min(length, begin + block_size);
+            m.rewind(0, empty);
+            m.append(src + begin, src + end);
+            m.decompose(false);
+            encode_matches(m.matches, 0, m.matches.size(), 0, blocks[b]);
+            encode_literals(m.matches, 0, m.matches.size(), m.data,
+                blocks[b]);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; t++) pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool) t.join();
+
+    Vector<uint8_t> hdr, tail;
+    put_u64(hdr, kMagic);
+    put_u64(hdr, block_size);
+    bool ok = fwrite(hdr.data(), 1, hdr.size(), f) == hdr.size();
+    uint64_t encoded = hdr.size();
+    for (size_t b = 0; ok && b < count; b++) {
+        put_u64(tail, b * block_size);
+        put_u64(tail, encoded);
+        put_u64(tail, blocks[b].size());
+        ok = fwrite(blocks[b].data(), 1, blocks[b].size(), f) ==
+            blocks[b].size();
+        encoded += blocks[b].size();
+    }
+    put_u64(tail, length);
+    put_u64(tail, count);
+    put_u64(tail, encoded);
+    put_u64(tail, kMagic);
+    return ok && fwrite(tail.data(), 1, tail.size(), f) == tail.size();
+}
+
+/** read the header, footer and index of a container. */
+inline bool Container::open(int fd)
+{
+    uint8_t hdr[16], footer[32];
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size < off_t(sizeof(hdr) + sizeof(footer)) ||
+        pread(fd, hdr, sizeof(hdr), 0) != ssize_t(sizeof(hdr)) ||
+        pread(fd, footer, sizeof(footer), size - sizeof(footer)) !=
+            ssize_t(sizeof(footer)) ||
+        get_u64(hdr) != kMagic || get_u64(footer + 24) != kMagic) {
+        return false;
+    }
+    this->fd = fd;
+    block_size = get_u64(hdr + 8);
+    length = get_u64(footer);
+    uint64_t count = get_u64(footer + 8), at = get_u64(footer + 16);
+    if (block_size == 0 || count != (length + block_size - 1) / block_size ||
+        at + count * 24 + sizeof(footer) != uint64_t(size)) {
+        return false;
+    }
+
+    Vector<uint8_t> buf(count * 24);
+    if (pread(fd, buf.data(), buf.size(), at) != ssize_t(buf.size())) {
+        return false;
+    }
+    index.resize(count);
+    for (size_t b = 0; b < count; b++) {
+        const uint8_t *p = &buf[b * 24];
+        index[b] = { get_u64(p), get_u64(p + 8), get_u64(p + 16) };
+        if (index[b].offset != b * block_size ||
+            index[b].encoded + index[b].length > at) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/** decode one block, replacing out. */
+inline bool Container::read_block(size_t i, Vector<char> &out) const
+{
+    const Entry &e = index[i];
+    Vector<uint8_t> buf(e.length);
+    out.clear();
+    size_t expect = std::min(block_size, length - e.offset);
+    return pread(fd, buf.data(), buf.size(), e.encoded) ==
+        ssize_t(buf.size()) &&
+        decode_payload(buf.data(), buf.data() + buf.size(), expect, out) &&
+        out.size() == expect;
+}
+
+/** decode every block in parallel into place. */
+inline bool Container::read(size_t threads, Vector<char> &out) const
+{
+    out.resize(length);
+    std::atomic<size_t> next(0);
+    std::atomic<bool> ok(true);
+    auto worker = [&]() {
+        Vector<char> block;
+        size_t b;
+        while ((b = next++) < index.size()) {
+            if (!read_block(b, block)) {
+                ok = false;
+                continue;
+            }
+            std::copy(block.begin(), block.end(),
+                out.begin() + index[b].offset);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; t++) pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool) t.join();
+    return ok;
+}
+
+/** decode only the blocks covering [begin,end). */
+inline bool Container::read_range(size_t begin, size_t end,
+    Vector<char> &out) const
+{
+    end = std::min(size_t(length), end);
+    out.clear();
+    if (begin >= end) return true;
+    Vector<char> block;
+    for (size_t b = begin / block_size; b * block_size < end; b++) {
+        if (!read_block(b, block)) return false;
+        size_t lo = std::max(begin, size_t(b * block_size)) - b * block_size;
+        size_t hi = std::min(end - b * block_size, block.size());
+        out.insert(out.end(), block.begin() + lo, block.begin() + hi);
+    }
+    return true;
+}
@@ -0,0 +1,183 @@
+/*
+ * Encoding
+ *
+ * Compact binary encoding of edit lists.
+ *
+ * Copyright (c) 2020, Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "matcher.h"
+
+/** append a little-endian 32-bit integer. */
+static inline void put_u32(Vector<uint8_t> &out, uint32_t v)
+{
+    for (size_t i = 0; i < 4; i++) out.push_back(uint8_t(v >> (i * 8)));
+}
+
+/** append a little-endian 64-bit integer. */
+static inline void put_u64(Vector<uint8_t> &out, uint64_t v)
+{
+    for (size_t i = 0; i < 8; i++) out.push_back(uint8_t(v >> (i * 8)));
+}
+
+/** read a little-endian 32-bit integer. */
+static inline uint32_t get_u32(const uint8_t *p)
+{
+    uint32_t v = 0;
+    for (size_t i = 0; i < 4; i++) v |= uint32_t(p[i]) << (i * 8);
+    return v;
+}
+
+/** read a little-endian 64-bit integer. */
+static inline uint64_t get_u64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (size_t i = 0; i < 8; i++) v |= uint64_t(p[i]) << (i * 8);
+    return v;
+}
+
+/** append an unsigned LEB128 variable length integer. */
+static inline void put_varint(Vector<uint8_t> &out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out.push_back(uint8_t(v) | 0x80);
+        v >>= 7;
+    }
+    out.push_back(uint8_t(v));
+}
+
+/** read an unsigned LEB128 variable length integer, false if truncated. */
+static inline bool get_varint(const uint8_t *&p, const uint8_t *end,
+    uint64_t &v)
+{
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+/**
+ * encode instructions that produce output from position base onwards.
+ *
+ * The header is base and the instruction count. Each instruction is its
+ * length shifted left by two or'ed with its type, and copies follow with
+ * their distance back from the output position. Literal offsets are the
+ * output position, so literal symbols are carried by the caller.
+ */
+template <typename Size>
+void encode_matches(const Vector<Match<Size>> &matches, size_t begin,
+    size_t end, size_t base, Vector<uint8_t> &out)
+{
+    put_varint(out, base);
+    put_varint(out, end - begin);
+    size_t pos = base;
+    for (size_t i = begin; i < end; i++) {
+        const Match<Size> &n = matches[i];
+        put_varint(out, (uint64_t(n.length) << 2) | n.type);
+        if (n.type != MatchType::Literal) put_varint(out, pos - n.offset);
+        pos += n.length;
+    }
+}
+
+/** decode instructions written by encode_matches, false if malformed. */
+template <typename Size>
+bool decode_matches(const uint8_t *&p, const uint8_t *end, size_t &base,
+    Vector<Match<Size>> &matches)
+{
+    uint64_t b, count, v, dist;
+    if (!get_varint(p, end, b) || !get_varint(p, end, count)) return false;
+    base = b;
+    size_t pos = base;
+    for (uint64_t i = 0; i < count; i++) {
+        if (!get_varint(p, end, v)) return false;
+        MatchType type = MatchType(v & 3);
+        size_t length = v >> 2, offset = pos;
+        if (type != MatchType::Literal) {
+            if (!get_varint(p, end, dist) || dist == 0 || dist > pos) {
+                return false;
+            }
+            offset = pos - dist;
+        }
+        matches.push_back({ type, Size(offset), Size(length) });
+        pos += length;
+    }
+    return true;
+}
+
+/** append the symbols of the literal instructions in order. */
+template <typename Size, typename Source>
+void encode_literals(const Vector<Match<Size>> &matches, size_t begin,
+    size_t end, const Source &source, Vector<uint8_t> &out)
+{
+    for (size_t i = begin; i < end; i++) {
+        const Match<Size> &n = matches[i];
+        if (n.type != MatchType::Literal) continue;
+        for (size_t j = 0; j < n.length; j++) {
+            out.push_back(uint8_t(source[n.offset + j]));
+        }
+    }
+}
+
+/**
+ * decode instructions followed by their literal symbols onto out.
+ *
+ * The payload must start where out ends. Copies may refer back to
+ * anything already in out, and out may not grow past limit. Returns
+ * false if the payload is malformed.
+ */
+template <typename Symbol>
+bool decode_payload(const uint8_t *p, const uint8_t *end, size_t limit,
+    Vector<Symbol> &out)
+{
+    Vector<Match<uint64_t>> matches;
+    size_t base = 0;
+    if (!decode_matches(p, end, base, matches) || base != out.size() ||
+        base > limit) {
+        return false;
+    }
+    for (auto &n : matches) {
+        if (n.length > limit - out.size()) return false;
+        switch (n.type) {
+        case MatchType::Literal:
+            if (size_t(end - p) < n.length) return false;
+            out.insert(out.end(), p, p + n.length);
+            p += n.length;
+            break;
+        case MatchType::Copy:
+            for (size_t i = 0; i < n.length; i++) {
+                out.push_back(out[n.offset + i]);
+            }
+            break;
+        case MatchType::RevComp:
+            /* the source is read backwards so must already be in out */
+            if (n.offset + n.length > out.size()) return false;
+            for (size_t i = 0; i < n.length; i++) {
+                out.push_back(complement(out[n.offset + n.length - 1 - i]));
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+    return p == end;
+}
@@ -0,0 +1,162 @@
+/*
+ * FASTA
+ *
+ * Streaming FASTA and FASTQ reader.
+ *
+ * Copyright (c) 2020, Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstddef>
+#include <vector>
+#include <string>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/** return the first newline in [p,end) or end, scanning a vector at a time. */
+static inline const char* scan_newline(const char *p, const char *end)
+{
+#if defined(__AVX2__)
+    const __m256i nl = _mm256_set1_epi8('\n');
+    for (; p + 32 <= end; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        unsigned m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+        if (m) return p + __builtin_ctz(m);
+    }
+#elif defined(__SSE2__)
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; p + 16 <= end; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        unsigned m = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        if (m) return p + __builtin_ctz(m);
+    }
+#endif
+    for (; p < end; p++) {
+        if (*p == '\n') return p;
+    }
+    return end;
+}
+
+/**
+ * streaming FASTA and FASTQ reader.
+ *
+ * Reads fixed size blocks and calls back with each record name, each run
+ * of sequence symbols with formatting removed, and the end of each record.
+ * Sequence lines are passed through without being buffered so records may
+ * be longer than the block size. FASTQ quality lines are skipped by count.
+ */
+struct FastaReader
+{
+    static const size_t kBlockSize = 1 << 20;
+
+    enum State { Start, Header, Sequence, Plus, Quality };
+
+    FILE *file;
+    std::vector<char> block;
+
+    FastaReader(FILE *file) : file(file), block(kBlockSize) {}
+
+    template <typename OnRecord, typename OnSequence, typename OnEnd>
+    void read(OnRecord on_record, OnSequence on_sequence, OnEnd on_end);
+};
+
+template <typename OnRecord, typename OnSequence, typename OnEnd>
+void FastaReader::read(OnRecord on_record, OnSequence on_sequence,
+    OnEnd on_end)
+{
+    State state = Start;
+    std::string name;
+    bool line_start = true, fastq = false, in_record = false, cr = false;
+    size_t seq_count = 0, qual_count = 0;
+
+    size_t len;
+    while ((len = fread(block.data(), 1, block.size(), file)) > 0)
+    {
+        const char *p = block.data(), *end = p + len;
+
+        /* a carriage return held back from the last block was data */
+        if (cr && *p != '\n') on_sequence("\r", "\r" + 1);
+        cr = false;
+
+        while (p < end)
+        {
+            if (line_start) {
+                char c = *p;
+                if (state == Quality && qual_count >= seq_count) {
+                    state = Start;
+                }
+                if (state != Quality && (c == '>' || c == '@')) {
+                    if (in_record) on_end();
+                    in_record = true;
+                    fastq = c == '@';
+                    seq_count = qual_count = 0;
+                    name.clear();
+                    state = Header;
+                    p++;
+                    line_start = false;
+                    continue;
+                }
+                if (state == Sequence && fastq && c == '+') {
+                    state = Plus;
+                }
+                line_start = false;
+            }
+
+            const char *nl = scan_newline(p, end);
+            const char *eol = nl;
+            if (nl < end && eol > p && eol[-1] == '\r') eol--;
+
+            switch (state) {
+            case Start:
+                break;
+            case Header:
+                name.append(p, eol);
+                if (nl < end) {
+                    on_record(name);
+                    state = Sequence;
+                }
+                break;
+            case Sequence:
+                /* hold back a trailing carriage return split from its newline */
+                if (nl == end && eol > p && eol[-1] == '\r') {
+                    eol--;
+                    cr = true;
+                }
+                if (eol > p) on_sequence(p, eol);
+                seq_count += eol - p;
+                break;
+            case Plus:
+                if (nl < end) state = Quality;
+                break;
+            case Quality:
+                qual_count += eol - p;
+                break;
+            }
+
+            if (nl < end) {
+                line_start = true;
+                p = nl + 1;
+            } else {
+                p = end;
+            }
+        }
+    }
+
+    if (in_record) on_end();
+}
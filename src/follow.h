@@ -0,0 +1,148 @@
+/*
+ * Follow
+ *
+ * Tail a growing file, calling back with each region appended to it.
+ *
+ * Copyright (c) 2020, Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+
+/**
+ * growing file follower.
+ *
+ * Reads the file to its end, then sleeps in inotify until it is written
+ * again, so a region is passed on as soon as the write lands rather than
+ * at the next poll. Regions are cut at their last newline, holding back a
+ * partly written line until it is complete. Following stops when the file
+ * is unlinked or renamed, after passing on anything held back. Without
+ * inotify the file is polled every poll_usec.
+ */
+struct FileFollower
+{
+    static const size_t kReadSize = 65536;
+
+    int fd;
+    int notify;
+    size_t poll_usec;
+    std::vector<char> pending;
+
+    FileFollower() : fd(-1), notify(-1), poll_usec(10000), pending() {}
+    ~FileFollower() { close(); }
+
+    bool open(const char *filename);
+    void close();
+
+    template <typename F>
+    void run(F f);
+
+    bool read_available(std::vector<char> &buf);
+    bool wait();
+};
+
+/** open the file and watch it for writes. */
+inline bool FileFollower::open(const char *filename)
+{
+    if ((fd = ::open(filename, O_RDONLY)) < 0) return false;
+#if defined(__linux__)
+    notify = inotify_init1(IN_CLOEXEC);
+    if (notify >= 0 && inotify_add_watch(notify, filename, IN_MODIFY |
+        IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF) < 0) {
+        ::close(notify);
+        notify = -1;
+    }
+#endif
+    return true;
+}
+
+inline void FileFollower::close()
+{
+    if (notify >= 0) ::close(notify);
+    if (fd >= 0) ::close(fd);
+    notify = fd = -1;
+}
+
+/** read everything up to the current end of file, false on error. */
+inline bool FileFollower::read_available(std::vector<char> &buf)
+{
+    for (;;) {
+        size_t len = buf.size();
+        buf.resize(len + kReadSize);
+        ssize_t n = ::read(fd, buf.data() + len, kReadSize);
+        buf.resize(len + (n > 0 ? n : 0));
+        if (n == 0) return true;
+        if (n < 0 && errno != EINTR) return false;
+    }
+}
+
+/** block until the file changes, false once it is gone. */
+inline bool FileFollower::wait()
+{
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) < 0 || statbuf.st_nlink == 0) return false;
+
+#if defined(__linux__)
+    if (notify >= 0) {
+        /* events are only a wakeup, the file is read to its end anyway */
+        char events[4096];
+        ssize_t n = ::read(notify, events, sizeof(events));
+        if (n < 0 && errno != EINTR) return false;
+        for (char *p = events; n > 0 && p < events + n; ) {
+            const struct inotify_event *ev = (const struct inotify_event*)p;
+            if (ev->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)) {
+                return false;
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+        return true;
+    }
+#endif
+    usleep(poll_usec);
+    return true;
+}
+
+/** call f with each complete region of lines as it is appended. */
+template <typename F>
+void FileFollower::run(F f)
+{
+    bool live = true;
+    while (live) {
+        if (!read_available(pending)) break;
+        size_t i = pending.size();
+        while (i > 0 && pending[i - 1] != '\n') i--;
+        if (i > 0) {
+            f(pending.data(), i);
+            pending.erase(pending.begin(), pending.begin() + i);
+        }
+        live = wait();
+    }
+    read_available(pending);
+    if (pending.size() > 0) f(pending.data(), pending.size());
+    pending.clear();
+}
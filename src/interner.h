@@ -0,0 +1,97 @@
+/*
+ * Interner
+ *
+ * Map variable length tokens to dense 32-bit symbol ids.
+ *
+ * Copyright (c) 2020, Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <string>
+
+/** open addressing hash table interning tokens to dense symbol ids. */
+struct Interner
+{
+    static const size_t kInitialSlotBits = 10;
+
+    std::vector<uint32_t> slots;        /* symbol id + 1, zero is empty */
+    std::vector<uint64_t> hashes;       /* token hash indexed by symbol id */
+    std::vector<std::string> symbols;   /* token text indexed by symbol id */
+
+    Interner();
+
+    uint32_t intern(const char *token, size_t length);
+    const std::string& symbol(uint32_t id) const { return symbols[id]; }
+    size_t size() const { return symbols.size(); }
+
+    static uint64_t hash(const char *token, size_t length);
+
+    void grow();
+};
+
+inline Interner::Interner() : slots(1 << kInitialSlotBits), hashes(), symbols() {}
+
+/** FNV-1a hash of a token. */
+inline uint64_t Interner::hash(const char *token, size_t length)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < length; i++) {
+        h = (h ^ uint8_t(token[i])) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+/** double the slot table and reinsert ids using their saved hashes. */
+inline void Interner::grow()
+{
+    std::vector<uint32_t> old(slots.size() << 1);
+    std::swap(slots, old);
+    size_t mask = slots.size() - 1;
+    for (uint32_t id = 0; id < symbols.size(); id++) {
+        size_t i = hashes[id] & mask;
+        while (slots[i]) i = (i + 1) & mask;
+        slots[i] = id + 1;
+    }
+}
+
+/** return the symbol id for a token, adding it if it is new. */
+inline uint32_t Interner::intern(const char *token, size_t length)
+{
+    /* keep load factor below one half so probe sequences stay short */
+    if ((symbols.size() + 1) * 2 > slots.size()) grow();
+
+    uint64_t h = hash(token, length);
+    size_t mask = slots.size() - 1;
+    size_t i = h & mask;
+    while (slots[i]) {
+        uint32_t id = slots[i] - 1;
+        if (hashes[id] == h && symbols[id].size() == length &&
+            memcmp(symbols[id].data(), token, length) == 0) {
+            return id;
+        }
+        i = (i + 1) & mask;
+    }
+
+    uint32_t id = uint32_t(symbols.size());
+    slots[i] = id + 1;
+    hashes.push_back(h);
+    symbols.push_back(std::string(token, length));
+    return id;
+}
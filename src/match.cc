@@ -42,14 +42,72 @@
  */
 
 #include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
+#include <dirent.h>
 #include <algorithm>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
 
 #include "matcher.h"
+#include "interner.h"
+#include "nucleotide.h"
+#include "fasta.h"
+#include "chunker.h"
+#include "rsync.h"
+#include "versions.h"
+#include "follow.h"
+#include "server.h"
+#include "async.h"
+#include "pipeline.h"
+#include "scheduler.h"
+#include "container.h"
+#include "access.h"
 
 static const char* filename = nullptr;
+static const char* output = nullptr;
+static std::vector<const char*> batch;
+static const char* container = nullptr;
+static const char* extract = nullptr;
+static const char* range = nullptr;
+static size_t segment_size = 4 << 20;
+static std::vector<const char*> refs;
+static const char* fasta = nullptr;
+static const char* follow = nullptr;
+static const char* serve_path = nullptr;
+static const char* connect_path = nullptr;
+static const char* dedupe = nullptr;
+static size_t chunk_size = 8192;
+static const char* signature = nullptr;
+static const char* delta_sig = nullptr;
+static const char* delta_new = nullptr;
+static size_t block_size = 2048;
 static const char* separator = nullptr;
 static const char* text = nullptr;
+static bool tokens = false;
+static bool dna = false;
+static bool reverse = false;
+static bool async = false;
+static bool prebuilt = false;
+static bool speculative = false;
+static size_t minimizer_w = 0;
+static size_t minimizer_k = 16;
+static size_t stride = 1;
+static bool after_copy = false;
+static CopyInsert copy_insert = InsertNone;
+static size_t max_insert = 0;
+static size_t long_min = 0;
+static size_t long_rate = 0;
+static double approx = 0;
+static bool lines = false;
+static size_t versions = 0;
+static std::vector<const char*> edits;
+static int window = 0;
+static const char* columns = nullptr;
+static int jobs = 1;
 static bool debug = false;
 static bool verbose = false;
 static bool help = false;
@@ -108,12 +166,65 @@ static size_t read_file(std::vector<uint8_t> &buf, const char* filename)
     return buf.size();
 }
 
+/** call back with the path of every regular file under a directory. */
+template <typename F>
+static void walk_dir(std::string path, F f)
+{
+    struct stat statbuf;
+    if (lstat(path.c_str(), &statbuf) < 0) {
+        fprintf(stderr, "lstat: %s: %s\n", path.c_str(), strerror(errno));
+        return;
+    }
+    if (S_ISREG(statbuf.st_mode)) {
+        f(path);
+        return;
+    }
+    if (!S_ISDIR(statbuf.st_mode)) {
+        return;
+    }
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        fprintf(stderr, "opendir: %s: %s\n", path.c_str(), strerror(errno));
+        return;
+    }
+    std::vector<std::string> names;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != nullptr) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+        names.push_back(ent->d_name);
+    }
+    closedir(dir);
+    /* sort so the walk order does not depend on the filesystem */
+    std::sort(names.begin(), names.end());
+    for (auto &name : names) {
+        walk_dir(path + "/" + name, f);
+    }
+}
+
+/* escape newlines and tabs so edits print on one line */
+static std::string escape(const char *str, size_t length)
+{
+    std::string s;
+    for (size_t i = 0; i < length; i++) {
+        switch (str[i]) {
+        case '\n': s.append("\\n"); break;
+        case '\t': s.append("\\t"); break;
+        default: s.push_back(str[i]); break;
+        }
+    }
+    return s;
+}
+
 /** string constant for match type. */
 static const char* match_type_name(MatchType type)
 {
     switch (type) {
     case MatchType::Literal: return "Literal";
     case MatchType::Copy: return "Copy";
+    case MatchType::RevComp: return "RevComp";
+    case MatchType::Approx: return "Approx";
     }
     return nullptr;
 }
@@ -132,11 +243,40 @@ matcher_stats calc_stats(M &m)
         switch (n.type) {
         case MatchType::Literal: literals += n.length; break;
         case MatchType::Copy: copies += n.length; break;
+        case MatchType::RevComp: copies += n.length; break;
+        case MatchType::Approx: copies += n.length; break;
         }
     }
     return { literals, copies };
 }
 
+/** apply matcher options from the command line. */
+template <typename M>
+void configure(M &m)
+{
+    m.reverse = reverse;
+    m.sampler.w = minimizer_w;
+    m.sampler.k = minimizer_k;
+    m.insert_stride = stride;
+    m.insert_after_copy = after_copy;
+    m.copy_insert = copy_insert;
+    if (copy_insert == InsertLimit) m.max_insert_length = max_insert;
+    m.window = window;
+    m.ldm.min_length = long_min;
+    if (long_rate) m.ldm.rate = long_rate;
+}
+
+/** copy symbols out of matcher storage into a string. */
+template <typename M>
+std::string symbol_string(M &m, size_t offset, size_t length)
+{
+    std::string str(length, '\0');
+    for (size_t i = 0; i < length; i++) {
+        str[i] = char(m.data[offset + i]);
+    }
+    return str;
+}
+
 template <typename M>
 void dump_matches(M &m)
 {
@@ -146,15 +286,17 @@ void dump_matches(M &m)
         printf("[%3zu] : %7s [ %3zd,%3zu )   # \"%s\"\n",
             std::distance(&m.matches[0], &n), match_type_name(n.type),
             offset - n.offset, size_t(n.length),
-            std::string(&m.data[n.offset], n.length).c_str());
+            symbol_string(m, offset, n.length).c_str());
         offset += n.length;
     }
 }
 
 /** test that runs the matcher and prints out the edit instructions. */
-void match_text(const char *syms, size_t length)
+template <typename Symbol>
+void match_symbols(const char *syms, size_t length)
 {
-    Matcher<> m(bits);
+    Matcher<Symbol> m(bits);
+    configure(m);
 
     if (separator) {
         std::vector<std::string> symbols =
@@ -173,11 +315,65 @@ void match_text(const char *syms, size_t length)
             printf("OriginalText: %s\n", std::string(syms, length).c_str());
         }
         m.append(syms, syms + length);
-        m.decompose();
+        if (prebuilt || speculative) m.index_all(jobs);
+        if (speculative) {
+            m.decompose_speculative(jobs);
+        } else {
+            m.decompose();
+        }
+    }
+
+    if (approx > 0) {
+        m.approximate(approx);
     }
 
     if (verbose) {
         dump_matches(m);
+        if (approx > 0) {
+            size_t nonzero = std::count_if(m.deltas.begin(), m.deltas.end(),
+                [](Symbol d) { return d != Symbol(0); });
+            printf("Deltas/NonZero: %zu/%zu\n", m.deltas.size(), nonzero);
+        }
+    }
+
+    if (debug) {
+        Vector<Symbol> out;
+        decode(m.matches, m.data, m.deltas, out);
+        bool ok = out.size() == m.data.size();
+        for (size_t i = 0; ok && i < out.size(); i++) ok = out[i] == m.data[i];
+        printf("Decode: %s\n", ok ? "ok" : "mismatch");
+    }
+
+    if (range) {
+        size_t begin = 0, end = 0;
+        sscanf(range, "%zu,%zu", &begin, &end);
+        RangeDecoder<Symbol,decltype(m.data),uint32_t> rd(m.matches,
+            m.data, &m.deltas);
+        Vector<Symbol> out;
+        rd.read(begin, end, out);
+        std::string str(out.size(), '\0');
+        for (size_t i = 0; i < out.size(); i++) str[i] = char(out[i]);
+        printf("Range [%zu,%zu): \"%s\"\n", begin, end,
+            escape(str.data(), str.size()).c_str());
+
+        /* check a grid of ranges against the data, then with checkpoints */
+        if (debug) {
+            bool ok = true;
+            size_t n = m.data.size(), step = std::max(size_t(1), n / 64);
+            for (int pass = 0; pass < 2; pass++) {
+                for (size_t a = 0; a < n; a += step) {
+                    for (size_t b = a; b <= std::min(n, a + step * 8);
+                        b += step) {
+                        rd.read(a, b, out);
+                        for (size_t i = 0; ok && i < out.size(); i++) {
+                            ok = out[i] == m.data[a + i];
+                        }
+                    }
+                }
+                rd.add_checkpoints(std::max(size_t(2), n / 8), n / 32 + 1);
+            }
+            printf("RangeDecode: %s\n", ok ? "ok" : "mismatch");
+        }
     }
 
     matcher_stats s = calc_stats(m);
@@ -186,6 +382,954 @@ void match_text(const char *syms, size_t length)
     MATCHER_DEBUG_PRINT("OuterIterations/InnerIterations: %zu/%zu\n", m.i1, m.i2);
 }
 
+/** test that appends blocks while a worker thread decomposes them. */
+template <typename Symbol>
+void match_async(const char *syms, size_t length)
+{
+    AsyncMatcher<Symbol> am(bits);
+    configure(am.m);
+    am.start();
+
+    /* wait on the first block so it is decomposed before the rest */
+    std::future<void> first = am.until(std::min(length, block_size));
+    for (size_t i = 0; i < length; i += block_size) {
+        am.append(syms + i, syms + std::min(length, i + block_size));
+    }
+    first.wait();
+    am.finish();
+
+    auto &m = am.m;
+    if (verbose) {
+        dump_matches(m);
+    }
+
+    if (debug) {
+        Vector<Symbol> out;
+        decode(m.matches, m.data, out);
+        bool ok = out.size() == m.data.size();
+        for (size_t i = 0; ok && i < out.size(); i++) ok = out[i] == m.data[i];
+        printf("Decode: %s\n", ok ? "ok" : "mismatch");
+    }
+
+    matcher_stats s = calc_stats(m);
+
+    printf("DataSize/Literals/Copies: %zu/%zu/%zu\n", m.data.size(), s.literals, s.copies);
+}
+
+/** test that applies in place edits and redoes the affected instructions. */
+void match_edits(const char *syms, size_t length)
+{
+    Matcher<char> m(bits);
+    configure(m);
+    m.sampler.w = 0;
+    m.ldm.min_length = 0;
+    m.append(syms, syms + length);
+    m.decompose();
+
+    /* edits are <pos>,<len>[,<text>] replacing len symbols at pos */
+    for (auto edit : edits) {
+        size_t pos = 0, len = 0;
+        int n = 0;
+        sscanf(edit, "%zu,%zu%n", &pos, &len, &n);
+        const char *str = edit[n] == ',' ? edit + n + 1 : edit + n;
+        pos = std::min(pos, m.data.size());
+        len = std::min(len, m.data.size() - pos);
+        m.replace(pos, len, str, str + strlen(str));
+        if (verbose) {
+            printf("Edit: %zu,%zu,\"%s\" Instructions: %zu\n",
+                pos, len, str, m.matches.size());
+        }
+    }
+
+    if (verbose) {
+        dump_matches(m);
+    }
+
+    if (debug) {
+        Vector<char> out;
+        decode(m.matches, m.data, out);
+        printf("Decode: %s\n", out == m.data ? "ok" : "mismatch");
+    }
+
+    matcher_stats s = calc_stats(m);
+
+    printf("DataSize/Literals/Copies: %zu/%zu/%zu\n", m.data.size(), s.literals, s.copies);
+}
+
+/** match text as bytes or as packed nucleotides. */
+void match_text(const char *syms, size_t length)
+{
+    if (async) {
+        if (dna) {
+            match_async<Base>(syms, length);
+        } else {
+            match_async<char>(syms, length);
+        }
+    } else if (dna) {
+        match_symbols<Base>(syms, length);
+    } else {
+        match_symbols<char>(syms, length);
+    }
+}
+
+template <typename M>
+void dump_tokens(M &m, Interner &in)
+{
+    /* output matches in token units with tokens joined by spaces */
+    ssize_t offset = 0;
+    for (auto &n : m.matches) {
+        std::string str;
+        for (size_t i = 0; i < n.length; i++) {
+            if (i > 0) str.append(" ");
+            str.append(in.symbol(m.data[n.offset + i]));
+        }
+        printf("[%3zu] : %7s [ %3zd,%3zu )   # \"%s\"\n",
+            std::distance(&m.matches[0], &n), match_type_name(n.type),
+            offset - n.offset, size_t(n.length), str.c_str());
+        offset += n.length;
+    }
+}
+
+/** test that interns tokens and runs the matcher over symbol ids. */
+void match_tokens(const char *syms, size_t length)
+{
+    Matcher<uint32_t> m(bits);
+    Interner in;
+
+    /* scan for separators using a lookup table rather than split() */
+    bool is_sep[256] = {};
+    const char *sep = separator ? separator : " \t\r\n";
+    for (const char *p = sep; *p; p++) is_sep[uint8_t(*p)] = true;
+
+    std::vector<uint32_t> ids;
+    size_t i = 0;
+    while (i < length) {
+        while (i < length && is_sep[uint8_t(syms[i])]) i++;
+        size_t j = i;
+        while (j < length && !is_sep[uint8_t(syms[j])]) j++;
+        if (j > i) ids.push_back(in.intern(syms + i, j - i));
+        i = j;
+    }
+
+    m.append(ids.begin(), ids.end());
+    m.decompose();
+
+    if (verbose) {
+        dump_tokens(m, in);
+    }
+
+    matcher_stats s = calc_stats(m);
+
+    printf("Tokens/Symbols: %zu/%zu\n", m.data.size(), in.size());
+    printf("DataSize/Literals/Copies: %zu/%zu/%zu\n", m.data.size(), s.literals, s.copies);
+    MATCHER_DEBUG_PRINT("OuterIterations/InnerIterations: %zu/%zu\n", m.i1, m.i2);
+}
+
+/** test that matches each line against a window of previous lines. */
+void match_lines(const char *syms, size_t length)
+{
+    Matcher<> m(bits);
+    std::vector<size_t> line_offset, line_match;
+
+    /* append and decompose each line including its newline */
+    size_t i = 0;
+    while (i < length) {
+        const char *nl = (const char*)memchr(syms + i, '\n', length - i);
+        size_t j = nl ? nl - syms + 1 : length;
+        size_t n = line_offset.size();
+        line_offset.push_back(m.data.size());
+        line_match.push_back(m.matches.size());
+        m.append(syms + i, syms + j);
+        /* copies may only start in the window of preceding lines */
+        m.window_start = window && n >= size_t(window) ?
+            line_offset[n - window] : 0;
+        m.decompose();
+        i = j;
+    }
+    line_match.push_back(m.matches.size());
+
+    /* output edits per line with copies as line:column references */
+    if (verbose) {
+        for (size_t l = 0; l < line_offset.size(); l++) {
+            printf("Line %zu:\n", l);
+            for (size_t k = line_match[l]; k < line_match[l + 1]; k++) {
+                auto &n = m.matches[k];
+                if (n.length == 0) continue;
+                size_t src = std::upper_bound(line_offset.begin(),
+                    line_offset.end(), size_t(n.offset)) -
+                    line_offset.begin() - 1;
+                printf("    %7s [ %3zu:%-3zu,%3zu )   # \"%s\"\n",
+                    match_type_name(n.type), src,
+                    size_t(n.offset) - line_offset[src], size_t(n.length),
+                    escape(&m.data[n.offset], n.length).c_str());
+            }
+        }
+    }
+
+    matcher_stats s = calc_stats(m);
+
+    printf("Lines/DataSize/Literals/Copies: %zu/%zu/%zu/%zu\n",
+        line_offset.size(), m.data.size(), s.literals, s.copies);
+    MATCHER_DEBUG_PRINT("OuterIterations/InnerIterations: %zu/%zu\n", m.i1, m.i2);
+}
+
+/** test that commits each line as a version with a bounded history. */
+void match_versions(const char *syms, size_t length)
+{
+    VersionStore<> vs(versions, bits);
+    configure(vs.m);
+    vs.m.sampler.w = 0;
+    vs.m.ldm.min_length = 0;
+    std::vector<std::string> docs;
+    size_t literals = 0, copies = 0;
+
+    size_t i = 0;
+    while (i < length) {
+        const char *nl = (const char*)memchr(syms + i, '\n', length - i);
+        size_t j = nl ? nl - syms + 1 : length;
+        size_t v = vs.commit(syms + i, syms + j);
+        docs.push_back(std::string(syms + i, j - i));
+        i = j;
+
+        /* count the instructions of the new version */
+        size_t lit = 0, cpy = 0;
+        for (size_t k = vs.index.back(); k < vs.m.matches.size(); k++) {
+            auto &n = vs.m.matches[k];
+            (n.type == MatchType::Literal ? lit : cpy) += n.length;
+        }
+        literals += lit;
+        copies += cpy;
+        if (verbose) {
+            printf("Version %zu: Size/Literals/Copies/Retained: "
+                "%zu/%zu/%zu/%zu\n", v, docs.back().size(), lit, cpy,
+                vs.count() - vs.first);
+        }
+    }
+
+    if (debug) {
+        bool ok = true;
+        for (size_t v = vs.first; v < vs.count(); v++) {
+            Vector<char> out;
+            ok = ok && vs.get(v, out) &&
+                std::string(out.begin(), out.end()) == docs[v];
+        }
+        printf("Decode: %s\n", ok ? "ok" : "mismatch");
+    }
+
+    printf("Versions/Retained/DataSize/Literals/Copies: %zu/%zu/%zu/%zu/%zu\n",
+        vs.count(), vs.count() - vs.first, vs.m.data.size(), literals, copies);
+}
+
+/** test that matches each column of delimited records separately. */
+void match_columns(const char *syms, size_t length)
+{
+    char delim = strcmp(columns, "\\t") == 0 ? '\t' : columns[0];
+    std::vector<std::unique_ptr<Matcher<>>> cols;
+    size_t rows = 0;
+
+    /* parse records routing each field into the matcher for its column */
+    size_t i = 0;
+    while (i < length) {
+        size_t col = 0;
+        bool eol = false;
+        while (!eol) {
+            std::string field;
+            bool quoted = i < length && syms[i] == '"';
+            if (quoted) i++;
+            while (i < length) {
+                char c = syms[i++];
+                if (quoted && c == '"') {
+                    if (i < length && syms[i] == '"') {
+                        field.push_back(syms[i++]);
+                    } else {
+                        quoted = false;
+                    }
+                } else if (!quoted && c == delim) {
+                    break;
+                } else if (!quoted && c == '\n') {
+                    eol = true;
+                    break;
+                } else {
+                    field.push_back(c);
+                }
+            }
+            if (i == length) eol = true;
+            if (eol && field.size() > 0 && field.back() == '\r') {
+                field.pop_back();
+            }
+            /* fields end with a newline so they do not run together */
+            field.push_back('\n');
+            if (col == cols.size()) {
+                cols.emplace_back(new Matcher<>(bits));
+                /* earlier rows had no value for this column */
+                std::string empty(rows, '\n');
+                cols.back()->append(empty.begin(), empty.end());
+            }
+            cols[col++]->append(field.begin(), field.end());
+        }
+        for (; col < cols.size(); col++) {
+            cols[col]->append("\n", "\n" + 1);
+        }
+        rows++;
+    }
+
+    /* columns are independent so decompose them in parallel */
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t c;
+        while ((c = next++) < cols.size()) {
+            cols[c]->decompose();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < jobs; t++) threads.emplace_back(worker);
+    worker();
+    for (auto &t : threads) t.join();
+
+    size_t data_size = 0, literals = 0, copies = 0;
+    for (size_t c = 0; c < cols.size(); c++) {
+        auto &m = *cols[c];
+        matcher_stats s = calc_stats(m);
+        if (verbose) {
+            printf("Column %zu:\n", c);
+            ssize_t offset = 0;
+            for (auto &n : m.matches) {
+                printf("    [%3zu] : %7s [ %3zd,%3zu )   # \"%s\"\n",
+                    std::distance(&m.matches[0], &n), match_type_name(n.type),
+                    offset - n.offset, size_t(n.length),
+                    escape(&m.data[n.offset], n.length).c_str());
+                offset += n.length;
+            }
+        }
+        printf("Column %zu DataSize/Literals/Copies: %zu/%zu/%zu\n",
+            c, m.data.size(), s.literals, s.copies);
+        data_size += m.data.size();
+        literals += s.literals;
+        copies += s.copies;
+    }
+
+    printf("Rows/Columns: %zu/%zu\n", rows, cols.size());
+    printf("DataSize/Literals/Copies: %zu/%zu/%zu\n", data_size, literals, copies);
+}
+
+/** test that matches sequences streamed from a FASTA or FASTQ file. */
+template <typename Symbol>
+void match_fasta_symbols(FILE *f)
+{
+    Matcher<Symbol> m(bits);
+    configure(m);
+    std::vector<std::string> names;
+    std::vector<size_t> record_offset;
+
+    /* each record is appended as it streams and decomposed at its end */
+    FastaReader reader(f);
+    reader.read([&](const std::string &name) {
+        names.push_back(name);
+        record_offset.push_back(m.data.size());
+    }, [&](const char *begin, const char *end) {
+        m.append(begin, end);
+    }, [&]() {
+        m.decompose();
+    });
+
+    /* output copies with their source as record:position */
+    if (verbose) {
+        for (size_t r = 0; r < names.size(); r++) {
+            printf("Record %zu: %s\n", r, names[r].c_str());
+        }
+        size_t offset = 0;
+        for (auto &n : m.matches) {
+            if (n.length == 0) continue;
+            size_t dst = std::upper_bound(record_offset.begin(),
+                record_offset.end(), offset) - record_offset.begin() - 1;
+            size_t src = std::upper_bound(record_offset.begin(),
+                record_offset.end(), size_t(n.offset)) -
+                record_offset.begin() - 1;
+            printf("[%3zu:%-7zu] : %7s [ %3zu:%-7zu,%7zu )\n",
+                dst, offset - record_offset[dst], match_type_name(n.type),
+                src, size_t(n.offset) - record_offset[src], size_t(n.length));
+            offset += n.length;
+        }
+    }
+
+    matcher_stats s = calc_stats(m);
+
+    printf("Records/DataSize/Literals/Copies: %zu/%zu/%zu/%zu\n",
+        names.size(), m.data.size(), s.literals, s.copies);
+    MATCHER_DEBUG_PRINT("OuterIterations/InnerIterations: %zu/%zu\n", m.i1, m.i2);
+}
+
+void match_fasta(const char *filename)
+{
+    FILE *f;
+    if ((f = fopen(filename, "r")) == nullptr) {
+        fprintf(stderr, "fopen: %s\n", strerror(errno));
+        exit(1);
+    }
+    if (dna) {
+        match_fasta_symbols<Base>(f);
+    } else {
+        match_fasta_symbols<char>(f);
+    }
+    fclose(f);
+}
+
+/** test that splits files into chunks and reports the dedupe ratio. */
+void match_dedupe(const char *path)
+{
+    DedupeStore ds(chunk_size);
+    size_t files = 0;
+
+    walk_dir(path, [&](const std::string &filename) {
+        std::vector<uint8_t> buf;
+        size_t len = read_file(buf, filename.c_str());
+        size_t chunks = ds.chunks.size();
+        Vector<uint32_t> refs;
+        ds.add(buf.data(), len, refs);
+        if (verbose) {
+            printf("File: %s Bytes/Chunks/NewChunks: %zu/%zu/%zu\n",
+                filename.c_str(), len, refs.size(), ds.chunks.size() - chunks);
+        }
+        files++;
+    });
+
+    printf("Files/Chunks/UniqueChunks: %zu/%zu/%zu\n",
+        files, ds.total_chunks, ds.chunks.size());
+    printf("Bytes/UniqueBytes/Ratio: %zu/%zu/%.3f\n",
+        ds.total_bytes, ds.store.size(),
+        ds.store.size() ? double(ds.total_bytes) / ds.store.size() : 1.0);
+}
+
+/** encode a file to a chunked stream, overlapping reads, matching and writes. */
+void match_pipeline(const char *filename, const char *output)
+{
+    /*
+     * A reader thread fills recycled buffers with pread, the main thread
+     * appends and decomposes each chunk as its own partition, and a writer
+     * thread encodes and writes the instructions of the chunk before, so
+     * the disk and the matcher are busy at the same time. The stages are
+     * connected by bounded queues, and an empty buffer or chunk ends them.
+     */
+    static const size_t kDepth = 4;
+    size_t chunk = std::max(block_size, size_t(65536));
+
+    int fd = open(filename, O_RDONLY);
+    FILE *out = fopen(output, "w");
+    if (fd < 0 || out == nullptr) {
+        fprintf(stderr, "open: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    SpscQueue<std::vector<uint8_t>> reads(kDepth), free_bufs(kDepth);
+    SpscQueue<StreamChunk<>> writes(kDepth);
+    for (size_t i = 0; i < kDepth; i++) {
+        free_bufs.push(std::vector<uint8_t>(chunk));
+    }
+
+    int read_error = 0;
+    std::thread reader([&]() {
+        off_t offset = 0;
+        for (;;) {
+            std::vector<uint8_t> buf;
+            free_bufs.pop(buf);
+            buf.resize(chunk);
+            ssize_t n;
+            do {
+                n = pread(fd, buf.data(), chunk, offset);
+            } while (n < 0 && errno == EINTR);
+            /* an error ends the stream early and is reported after join */
+            if (n < 0) read_error = errno;
+            buf.resize(n > 0 ? n : 0);
+            offset += buf.size();
+            bool last = buf.empty();
+            reads.push(std::move(buf));
+            if (last) break;
+        }
+    });
+
+    bool write_ok = true;
+    std::thread writer([&]() {
+        Vector<uint8_t> enc;
+        for (;;) {
+            StreamChunk<> c;
+            writes.pop(c);
+            if (c.matches.empty()) break;
+            write_ok = write_ok && write_chunk(out, c, enc);
+        }
+    });
+
+    Matcher<> m(bits);
+    configure(m);
+    size_t chunks = 0;
+    for (;;) {
+        std::vector<uint8_t> buf;
+        reads.pop(buf);
+        if (buf.empty()) break;
+        size_t first = m.matches.size(), pos = m.data.size();
+        m.append(buf.begin(), buf.end());
+        buf.resize(chunk);
+        free_bufs.push(std::move(buf));
+        m.decompose();
+
+        /* partitions keep earlier instructions final, so hand them off */
+        StreamChunk<> c;
+        c.base = pos;
+        for (size_t k = first; k < m.matches.size(); k++) {
+            auto &n = m.matches[k];
+            if (n.length == 0) continue;
+            c.matches.push_back(n);
+            if (n.type == MatchType::Literal) {
+                c.literals.insert(c.literals.end(), m.data.begin() + pos,
+                    m.data.begin() + pos + n.length);
+            }
+            pos += n.length;
+        }
+        writes.push(std::move(c));
+        chunks++;
+    }
+    writes.push(StreamChunk<>());
+    reader.join();
+    writer.join();
+    close(fd);
+    if (read_error) {
+        fprintf(stderr, "error: reading %s: %s\n", filename,
+            strerror(read_error));
+        exit(1);
+    }
+    if (fclose(out) != 0 || !write_ok) {
+        fprintf(stderr, "error: writing %s: %s\n", output, strerror(errno));
+        exit(1);
+    }
+
+    if (debug) {
+        Vector<char> dec;
+        FILE *f = fopen(output, "r");
+        bool ok = f && decode_stream(f, m.data.size(), dec) && dec == m.data;
+        if (f) fclose(f);
+        printf("Decode: %s\n", ok ? "ok" : "mismatch");
+    }
+
+    matcher_stats s = calc_stats(m);
+    struct stat statbuf;
+    stat(output, &statbuf);
+
+    printf("Chunks/DataSize/Literals/Copies/OutputSize: %zu/%zu/%zu/%zu/%zu\n",
+        chunks, m.data.size(), s.literals, s.copies, size_t(statbuf.st_size));
+}
+
+/** test that matches many files in parallel with one matcher per worker. */
+void match_batch()
+{
+    struct FileStats
+    {
+        std::string name;
+        size_t size;
+        std::atomic<size_t> segments, literals, copies;
+    };
+
+    std::vector<std::string> names;
+    for (auto path : batch) {
+        walk_dir(path, [&](const std::string &name) { names.push_back(name); });
+    }
+    std::unique_ptr<FileStats[]> stats(new FileStats[names.size()]());
+
+    TaskPool pool(jobs);
+    std::vector<std::unique_ptr<Matcher<>>> workers;
+    for (size_t w = 0; w < pool.size(); w++) {
+        workers.emplace_back(new Matcher<>(bits));
+        configure(*workers.back());
+        workers.back()->sampler.w = 0;
+        workers.back()->ldm.min_length = 0;
+    }
+    std::atomic<bool> mismatch(false);
+    const Vector<uint32_t> empty;
+
+    /* each segment is decomposed on its own by the worker's matcher */
+    auto segment = [&](size_t w, FileStats &fs,
+        const std::shared_ptr<std::vector<uint8_t>> &buf, size_t a, size_t b)
+    {
+        Matcher<> &m = *workers[w];
+        m.rewind(0, empty);
+        m.append(buf->begin() + a, buf->begin() + b);
+        m.decompose();
+        matcher_stats s = calc_stats(m);
+        fs.segments++;
+        fs.literals += s.literals;
+        fs.copies += s.copies;
+        if (debug) {
+            Vector<char> out;
+            decode(m.matches, m.data, out);
+            if (out != m.data) mismatch = true;
+        }
+    };
+
+    /*
+     * Files are dealt out round robin. A file larger than a segment pushes
+     * its other segments onto the deque of the worker that read it, where
+     * idle workers can steal them, so one large file cannot stall the rest.
+     */
+    for (size_t i = 0; i < names.size(); i++) {
+        pool.push(i, [&, i](size_t w) {
+            FileStats &fs = stats[i];
+            auto buf = std::make_shared<std::vector<uint8_t>>();
+            fs.name = names[i];
+            fs.size = read_file(*buf, names[i].c_str());
+            for (size_t a = segment_size; a < fs.size; a += segment_size) {
+                size_t b = std::min(fs.size, a + segment_size);
+                pool.push(w, [&, buf, a, b](size_t w) {
+                    segment(w, fs, buf, a, b);
+                });
+            }
+            segment(w, fs, buf, 0, std::min(fs.size, segment_size));
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    pool.run();
+    double secs = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    size_t data_size = 0, segments = 0, literals = 0, copies = 0;
+    for (size_t i = 0; i < names.size(); i++) {
+        FileStats &fs = stats[i];
+        printf("File: %s Size/Segments/Literals/Copies: %zu/%zu/%zu/%zu\n",
+            fs.name.c_str(), fs.size, size_t(fs.segments),
+            size_t(fs.literals), size_t(fs.copies));
+        data_size += fs.size;
+        segments += fs.segments;
+        literals += fs.literals;
+        copies += fs.copies;
+    }
+
+    if (debug) {
+        printf("Decode: %s\n", mismatch ? "mismatch" : "ok");
+    }
+
+    printf("Files/Segments/Steals: %zu/%zu/%zu\n", names.size(), segments,
+        size_t(pool.steals));
+    printf("DataSize/Literals/Copies: %zu/%zu/%zu\n", data_size, literals, copies);
+    printf("Seconds/Throughput: %.3f/%.1f MB/s\n", secs,
+        secs > 0 ? data_size / secs / 1e6 : 0.0);
+}
+
+/** write a file as a container of independently matched blocks. */
+void match_container(const char *filename, const char *output)
+{
+    std::vector<uint8_t> buf;
+    size_t len = read_file(buf, filename);
+    FILE *f = fopen(output, "w");
+    if (f == nullptr) {
+        fprintf(stderr, "fopen: %s\n", strerror(errno));
+        exit(1);
+    }
+    bool ok = Container::write(f, buf.data(), len, segment_size, jobs,
+        [](Matcher<> &m) {
+            m.resize(bits);
+            configure(m);
+            m.sampler.w = 0;
+            m.ldm.min_length = 0;
+        });
+    if (fclose(f) != 0 || !ok) {
+        fprintf(stderr, "error: writing %s: %s\n", output, strerror(errno));
+        exit(1);
+    }
+
+    int fd = open(output, O_RDONLY);
+    Container c;
+    if (fd < 0 || !c.open(fd)) {
+        fprintf(stderr, "error: invalid container: %s\n", output);
+        exit(1);
+    }
+    if (debug) {
+        Vector<char> out;
+        ok = c.read(jobs, out) && out.size() == len &&
+            std::equal(out.begin(), out.end(), (const char*)buf.data());
+        printf("Decode: %s\n", ok ? "ok" : "mismatch");
+    }
+    printf("Blocks/DataSize/ContainerSize: %zu/%zu/%zu\n", c.index.size(),
+        len, size_t(lseek(fd, 0, SEEK_END)));
+    close(fd);
+}
+
+/** write a container, or the byte range of it given with --range, to stdout. */
+void match_extract(const char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    Container c;
+    if (fd < 0 || !c.open(fd)) {
+        fprintf(stderr, "error: invalid container: %s\n", filename);
+        exit(1);
+    }
+    Vector<char> out;
+    bool ok;
+    if (range) {
+        size_t begin = 0, end = 0;
+        sscanf(range, "%zu,%zu", &begin, &end);
+        ok = c.read_range(begin, end, out);
+    } else {
+        ok = c.read(jobs, out);
+    }
+    close(fd);
+    if (!ok) {
+        fprintf(stderr, "error: corrupt container: %s\n", filename);
+        exit(1);
+    }
+    if (fwrite(out.data(), 1, out.size(), stdout) != out.size()) {
+        fprintf(stderr, "error: writing output: %s\n", strerror(errno));
+        exit(1);
+    }
+}
+
+/** write the block signature of a file to stdout. */
+void match_signature(const char *filename)
+{
+    std::vector<uint8_t> buf;
+    size_t len = read_file(buf, filename);
+    BlockSignature sig(block_size);
+    sig.compute(buf.data(), len);
+    if (!sig.write(stdout)) {
+        fprintf(stderr, "error: writing signature: %s\n", strerror(errno));
+        exit(1);
+    }
+}
+
+/** print the delta of a file against a block signature. */
+void match_delta(const char *sig_filename, const char *filename)
+{
+    BlockSignature sig;
+    FILE *f;
+    if ((f = fopen(sig_filename, "r")) == nullptr) {
+        fprintf(stderr, "fopen: %s\n", strerror(errno));
+        exit(1);
+    }
+    if (!sig.read(f)) {
+        fprintf(stderr, "error: invalid signature: %s\n", sig_filename);
+        exit(1);
+    }
+    fclose(f);
+
+    std::vector<uint8_t> buf;
+    size_t len = read_file(buf, filename);
+    Vector<Match<uint64_t>> matches;
+    sig.delta(buf.data(), len, matches);
+
+    /* output in this format: Literal [new,len) or Copy [old,len) */
+    size_t literals = 0, copies = 0;
+    for (auto &n : matches) {
+        if (verbose) {
+            printf("[%3zu] : %7s [ %7zu,%7zu )\n",
+                std::distance(&matches[0], &n), match_type_name(n.type),
+                size_t(n.offset), size_t(n.length));
+        }
+        if (n.type == MatchType::Literal) {
+            literals += n.length;
+        } else {
+            copies += n.length;
+        }
+    }
+
+    printf("Blocks/DataSize/Literals/Copies: %zu/%zu/%zu/%zu\n",
+        sig.weak.size(), len, literals, copies);
+}
+
+/** print the delta of a target against several reference files. */
+void match_references(const char *syms, size_t length)
+{
+    Matcher<char> m(bits);
+    configure(m);
+
+    std::vector<uint8_t> buf;
+    for (auto ref : refs) {
+        size_t len = read_file(buf, ref);
+        m.add_reference(buf.begin(), buf.begin() + len);
+    }
+    m.index_references(jobs);
+    m.append(syms, syms + length);
+    m.decompose();
+    m.split_references();
+
+    /* output in this format: Copy [r<ref>:offset,len) or Literal [n0:offset,len) */
+    size_t literals = 0, copies = 0, ref_copies = 0;
+    for (auto &n : m.matches) {
+        size_t r = m.reference_of(n.offset);
+        bool from_ref = n.type != MatchType::Literal && r < refs.size();
+        size_t base = from_ref ? m.ref_offset[r] : m.ref_end;
+        if (verbose) {
+            printf("[%3zu] : %7s [ %c%zu:%zu,%zu )\n",
+                std::distance(&m.matches[0], &n), match_type_name(n.type),
+                from_ref ? 'r' : 'n', from_ref ? r : 0,
+                size_t(n.offset) - base, size_t(n.length));
+        }
+        if (n.type == MatchType::Literal) {
+            literals += n.length;
+        } else {
+            copies += n.length;
+            if (from_ref) ref_copies += n.length;
+        }
+    }
+
+    if (debug) {
+        Vector<char> out(m.data.begin(), m.data.begin() + m.ref_end);
+        decode(m.matches, m.data, out);
+        bool ok = out == m.data;
+        printf("Decode: %s\n", ok ? "ok" : "mismatch");
+    }
+
+    printf("References/DataSize/Literals/Copies/RefCopies: "
+        "%zu/%zu/%zu/%zu/%zu\n", refs.size(), length, literals, copies,
+        ref_copies);
+}
+
+/** test that follows a growing file and streams instructions for it. */
+void match_follow(const char *filename)
+{
+    FileFollower ff;
+    if (!ff.open(filename)) {
+        fprintf(stderr, "open: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    Matcher<> m(bits);
+    configure(m);
+    bool sliding = window > 0 && !m.sampler.w && !m.ldm.min_length;
+    size_t base = 0, count = 0, literals = 0, copies = 0;
+    Vector<Match<size_t>> edits;
+    Vector<char> all;
+
+    /*
+     * Each region is appended and decomposed as its own partition, so the
+     * instructions before it are final and can be written out straight
+     * away. With a window, history past twice the window is evicted at
+     * an instruction boundary, and offsets are printed from the start of
+     * the file.
+     */
+    ff.run([&](const char *buf, size_t len) {
+        size_t first = m.matches.size(), offset = m.data.size();
+        m.append(buf, buf + len);
+        m.decompose();
+        if (debug) all.insert(all.end(), buf, buf + len);
+
+        for (size_t k = first; k < m.matches.size(); k++) {
+            auto &n = m.matches[k];
+            if (n.length == 0) continue;
+            printf("[%3zu] : %7s [ %7zu,%5zu )   # \"%s\"\n", count++,
+                match_type_name(n.type), base + (n.type == MatchType::Literal
+                    ? offset : size_t(n.offset)), size_t(n.length),
+                escape(&m.data[offset], n.length).c_str());
+            (n.type == MatchType::Literal ? literals : copies) += n.length;
+            if (debug) {
+                edits.push_back({ n.type, base + (n.type == MatchType::Literal
+                    ? offset : size_t(n.offset)), size_t(n.length) });
+            }
+            offset += n.length;
+        }
+        fflush(stdout);
+
+        if (sliding && m.data.size() > size_t(window) * 2) {
+            size_t n = 0, pos = 0;
+            for (auto &i : m.matches) {
+                if (pos + i.length > m.data.size() - window) break;
+                pos += i.length;
+                n = pos;
+            }
+            m.slide(n);
+            base += n;
+        }
+    });
+
+    if (debug) {
+        Vector<char> out;
+        decode(edits, all, out);
+        printf("Decode: %s\n", out == all ? "ok" : "mismatch");
+    }
+
+    printf("DataSize/Literals/Copies: %zu/%zu/%zu\n",
+        base + m.data.size(), literals, copies);
+}
+
+/** run a match server on a Unix domain socket primed with references. */
+void match_serve(const char *path)
+{
+    MatchServer<> server(jobs);
+    if (!server.listen(path)) {
+        fprintf(stderr, "listen: %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+
+    /* every worker reads the references once and keeps them indexed */
+    server.run([](Matcher<> &m) {
+        m.resize(bits);
+        configure(m);
+        m.sampler.w = 0;
+        m.ldm.min_length = 0;
+        std::vector<uint8_t> buf;
+        for (auto ref : refs) {
+            size_t len = read_file(buf, ref);
+            m.add_reference(buf.begin(), buf.begin() + len);
+        }
+        if (refs.size()) m.index_references(1);
+    });
+}
+
+/** test that sends symbols to a match server and prints its reply. */
+void match_connect(const char *syms, size_t length)
+{
+    int fd = connect_unix(connect_path);
+    if (fd < 0) {
+        fprintf(stderr, "connect: %s: %s\n", connect_path, strerror(errno));
+        exit(1);
+    }
+    Vector<uint8_t> resp;
+    if (!write_frame(fd, (const uint8_t*)syms, length) ||
+        !read_frame(fd, resp)) {
+        fprintf(stderr, "error: no reply from %s\n", connect_path);
+        exit(1);
+    }
+    close(fd);
+
+    Vector<Match<uint32_t>> matches;
+    const uint8_t *p = resp.data();
+    size_t base = 0;
+    if (!decode_matches(p, p + resp.size(), base, matches)) {
+        fprintf(stderr, "error: malformed reply from %s\n", connect_path);
+        exit(1);
+    }
+
+    /* the server's references precede the symbols, as with --ref */
+    Vector<char> all, out;
+    std::vector<uint8_t> buf;
+    for (auto ref : refs) {
+        size_t len = read_file(buf, ref);
+        all.insert(all.end(), buf.begin(), buf.begin() + len);
+    }
+    if (all.size() != base) {
+        fprintf(stderr, "error: references differ from the server\n");
+        exit(1);
+    }
+    all.insert(all.end(), syms, syms + length);
+
+    size_t literals = 0, copies = 0, pos = base;
+    for (auto &n : matches) {
+        if (verbose) {
+            printf("[%3zu] : %7s [ %3zd,%3zu )   # \"%s\"\n",
+                std::distance(&matches[0], &n), match_type_name(n.type),
+                ssize_t(pos) - ssize_t(n.offset), size_t(n.length),
+                escape(&all[pos], n.length).c_str());
+        }
+        (n.type == MatchType::Literal ? literals : copies) += n.length;
+        pos += n.length;
+    }
+
+    if (debug) {
+        out.assign(all.begin(), all.begin() + base);
+        decode(matches, all, out);
+        printf("Decode: %s\n", out == all ? "ok" : "mismatch");
+    }
+
+    printf("ReplyBytes/DataSize/Literals/Copies: %zu/%zu/%zu/%zu\n",
+        resp.size(), length, literals, copies);
+}
+
 /*
  * command line options
  */
@@ -193,12 +1337,45 @@ void match_text(const char *syms, size_t length)
 void print_help(int argc, char **argv)
 {
     fprintf(stderr,
-        "Usage: %s [options]\n"
+        "Usage: %s [options] [<file|dir>...]\n"
         "\n"
         "Options:\n"
         "  -t, --text <text>            symbols from argument\n"
         "  -f, --file <filename>        symbols from file\n"
+        "  -o, --output <filename>      write file as a chunked edit stream\n"
+        "  -O, --container <filename>   write file as a block container\n"
+        "  -X, --extract <filename>     decode a block container to stdout\n"
+        "  -Q, --range <begin>,<end>    decode only a byte range\n"
+        "  -e, --ref <filename>         delta against reference, repeatable\n"
+        "  -a, --fasta <filename>       sequences from FASTA/FASTQ file\n"
+        "  -F, --follow <filename>      stream matches as the file grows\n"
+        "  -P, --serve <socket>         serve matches on a Unix socket\n"
+        "  -K, --connect <socket>       match symbols using a server\n"
+        "  -D, --dedupe <path>          chunk files and report dedupe ratio\n"
+        "  -S, --chunk-size <size>      average chunk size for dedupe\n"
+        "  -G, --signature <old>        write rsync block signature\n"
+        "  -R, --delta <sig> <new>      print delta against signature\n"
+        "  -B, --block-size <size>      block size for signature\n"
         "  -s, --split <separator>      split input symbols\n"
+        "  -k, --tokens                 match interned tokens\n"
+        "  -n, --dna                    match 2-bit packed nucleotides\n"
+        "  -r, --reverse                match reverse complement copies\n"
+        "  -A, --async                  decompose blocks on a worker thread\n"
+        "  -y, --prebuilt               build the index in parallel first\n"
+        "  -Y, --speculative            parse blocks of a prebuilt index in parallel\n"
+        "  -m, --minimizer <w>[,<k>]    index only (w,k)-minimizer anchors\n"
+        "  -i, --stride <n>             index only every n-th position\n"
+        "  -C, --after-copy             index only positions following copies\n"
+        "  -I, --copy-insert <n|all>    index positions inside short copies\n"
+        "  -l, --lines                  match lines against prior lines\n"
+        "  -V, --versions <size>        commit lines as versions in a window\n"
+        "  -E, --edit <pos>,<len>,<str> replace symbols after matching\n"
+        "  -w, --window <size>          limit matches to prior lines or symbols\n"
+        "  -L, --long <min>[,<rate>]    find long distance matches\n"
+        "  -x, --approx <rate>          extend copies with mismatch rate\n"
+        "  -c, --columns <delimiter>    match columns of delimited records\n"
+        "  -j, --jobs <count>           number of worker threads\n"
+        "  -g, --segment <size>         segment size for batches and containers\n"
         "  -b, --bits <width>           specity hash table size\n"
         "  -v, --verbose                enable verbose output\n"
         "  -d, --debug                  enable debug output\n"
@@ -229,12 +1406,121 @@ void parse_options(int argc, char **argv)
         } else if (match_opt(argv[i], "-f", "--file")) {
             if (check_param(++i == argc, "--file")) break;
             filename = argv[i++];
+        } else if (match_opt(argv[i], "-o", "--output")) {
+            if (check_param(++i == argc, "--output")) break;
+            output = argv[i++];
+        } else if (match_opt(argv[i], "-O", "--container")) {
+            if (check_param(++i == argc, "--container")) break;
+            container = argv[i++];
+        } else if (match_opt(argv[i], "-X", "--extract")) {
+            if (check_param(++i == argc, "--extract")) break;
+            extract = argv[i++];
+        } else if (match_opt(argv[i], "-Q", "--range")) {
+            if (check_param(++i == argc, "--range")) break;
+            range = argv[i++];
+        } else if (match_opt(argv[i], "-e", "--ref")) {
+            if (check_param(++i == argc, "--ref")) break;
+            refs.push_back(argv[i++]);
+        } else if (match_opt(argv[i], "-a", "--fasta")) {
+            if (check_param(++i == argc, "--fasta")) break;
+            fasta = argv[i++];
+        } else if (match_opt(argv[i], "-F", "--follow")) {
+            if (check_param(++i == argc, "--follow")) break;
+            follow = argv[i++];
+        } else if (match_opt(argv[i], "-P", "--serve")) {
+            if (check_param(++i == argc, "--serve")) break;
+            serve_path = argv[i++];
+        } else if (match_opt(argv[i], "-K", "--connect")) {
+            if (check_param(++i == argc, "--connect")) break;
+            connect_path = argv[i++];
+        } else if (match_opt(argv[i], "-D", "--dedupe")) {
+            if (check_param(++i == argc, "--dedupe")) break;
+            dedupe = argv[i++];
+        } else if (match_opt(argv[i], "-S", "--chunk-size")) {
+            if (check_param(++i == argc, "--chunk-size")) break;
+            chunk_size = std::max(64, atoi(argv[i++]));
+        } else if (match_opt(argv[i], "-G", "--signature")) {
+            if (check_param(++i == argc, "--signature")) break;
+            signature = argv[i++];
+        } else if (match_opt(argv[i], "-R", "--delta")) {
+            if (check_param(i + 2 >= argc, "--delta")) break;
+            delta_sig = argv[++i];
+            delta_new = argv[++i];
+            i++;
+        } else if (match_opt(argv[i], "-B", "--block-size")) {
+            if (check_param(++i == argc, "--block-size")) break;
+            block_size = std::max(16, atoi(argv[i++]));
         } else if (match_opt(argv[i], "-s", "--separator")) {
             if (check_param(++i == argc, "--separator")) break;
             separator = argv[i++];
         } else if (match_opt(argv[i], "-b", "--bits")) {
             if (check_param(++i == argc, "--bits")) break;
             bits = atoi(argv[i++]);
+        } else if (match_opt(argv[i], "-k", "--tokens")) {
+            tokens = true;
+            i++;
+        } else if (match_opt(argv[i], "-n", "--dna")) {
+            dna = true;
+            i++;
+        } else if (match_opt(argv[i], "-r", "--reverse")) {
+            reverse = true;
+            i++;
+        } else if (match_opt(argv[i], "-A", "--async")) {
+            async = true;
+            i++;
+        } else if (match_opt(argv[i], "-y", "--prebuilt")) {
+            prebuilt = true;
+            i++;
+        } else if (match_opt(argv[i], "-Y", "--speculative")) {
+            speculative = true;
+            i++;
+        } else if (match_opt(argv[i], "-m", "--minimizer")) {
+            if (check_param(++i == argc, "--minimizer")) break;
+            sscanf(argv[i++], "%zu,%zu", &minimizer_w, &minimizer_k);
+        } else if (match_opt(argv[i], "-i", "--stride")) {
+            if (check_param(++i == argc, "--stride")) break;
+            stride = std::max(1, atoi(argv[i++]));
+        } else if (match_opt(argv[i], "-C", "--after-copy")) {
+            after_copy = true;
+            i++;
+        } else if (match_opt(argv[i], "-I", "--copy-insert")) {
+            if (check_param(++i == argc, "--copy-insert")) break;
+            if (strcmp(argv[i], "all") == 0) {
+                copy_insert = InsertAll;
+            } else if (strcmp(argv[i], "none") == 0) {
+                copy_insert = InsertNone;
+            } else {
+                copy_insert = InsertLimit;
+                max_insert = atoi(argv[i]);
+            }
+            i++;
+        } else if (match_opt(argv[i], "-L", "--long")) {
+            if (check_param(++i == argc, "--long")) break;
+            sscanf(argv[i++], "%zu,%zu", &long_min, &long_rate);
+        } else if (match_opt(argv[i], "-x", "--approx")) {
+            if (check_param(++i == argc, "--approx")) break;
+            approx = atof(argv[i++]);
+        } else if (match_opt(argv[i], "-l", "--lines")) {
+            lines = true;
+            i++;
+        } else if (match_opt(argv[i], "-V", "--versions")) {
+            if (check_param(++i == argc, "--versions")) break;
+            versions = std::max(1, atoi(argv[i++]));
+        } else if (match_opt(argv[i], "-E", "--edit")) {
+            if (check_param(++i == argc, "--edit")) break;
+            edits.push_back(argv[i++]);
+        } else if (match_opt(argv[i], "-w", "--window")) {
+            if (check_param(++i == argc, "--window")) break;
+            window = atoi(argv[i++]);
+        } else if (match_opt(argv[i], "-c", "--columns")) {
+            if (check_param(++i == argc, "--columns")) break;
+            columns = argv[i++];
+        } else if (match_opt(argv[i], "-j", "--jobs")) {
+            if (check_param(++i == argc, "--jobs")) break;
+            jobs = std::max(1, atoi(argv[i++]));
+        } else if (match_opt(argv[i], "-g", "--segment")) {
+            if (check_param(++i == argc, "--segment")) break;
+            segment_size = std::max(1024, atoi(argv[i++]));
         } else if (match_opt(argv[i], "-d", "--debug")) {
             debug = true;
             i++;
@@ -244,6 +1530,8 @@ void parse_options(int argc, char **argv)
         } else if (match_opt(argv[i], "-h", "--help")) {
             help = true;
             i++;
+        } else if (argv[i][0] != '-') {
+            batch.push_back(argv[i++]);
         } else {
             fprintf(stderr, "error: unknown option: %s\n", argv[i]);
             help = true;
@@ -251,6 +1539,13 @@ void parse_options(int argc, char **argv)
         }
     }
 
+    /* the prebuilt index is only built for forward local matches */
+    if ((prebuilt || speculative) && (reverse || long_min || minimizer_w)) {
+        fprintf(stderr, "error: --prebuilt and --speculative cannot be "
+            "combined with --reverse, --long or --minimizer\n");
+        exit(1);
+    }
+
     if (help) {
         print_help(argc, argv);
         exit(1);
@@ -270,14 +1565,38 @@ int main(int argc, char **argv)
 {
     parse_options(argc, argv);
 
-    if (filename) {
+    auto match = connect_path ? match_connect : refs.size() ? match_references : columns ? match_columns :
+        versions ? match_versions : edits.size() ? match_edits :
+        lines ? match_lines : tokens ? match_tokens : match_text;
+
+    if (signature) {
+        match_signature(signature);
+    } else if (delta_sig) {
+        match_delta(delta_sig, delta_new);
+    } else if (dedupe) {
+        match_dedupe(dedupe);
+    } else if (fasta) {
+        match_fasta(fasta);
+    } else if (follow) {
+        match_follow(follow);
+    } else if (serve_path) {
+        match_serve(serve_path);
+    } else if (batch.size()) {
+        match_batch();
+    } else if (extract) {
+        match_extract(extract);
+    } else if (filename && container) {
+        match_container(filename, container);
+    } else if (filename && output) {
+        match_pipeline(filename, output);
+    } else if (filename) {
         std::vector<uint8_t> buf;
         size_t len = read_file(buf, filename);
-        match_text((const char*)&buf[0], len);
+        match((const char*)&buf[0], len);
     } else if (text) {
-        match_text(text, strlen(text));
+        match(text, strlen(text));
     } else {
-        fprintf(stderr, "error: must specify --text or --file\n");
+        fprintf(stderr, "error: must specify files, --text, --file, --fasta, --follow or --dedupe\n");
         exit(9);
     }
 }
@@ -41,6 +41,8 @@
  * jloup@gzip.org          madler@alumni.caltech.edu
  */
 
+#pragma once
+
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
@@ -49,6 +51,10 @@
 #include <vector>
 #include <string>
 #include <limits>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <functional>
 
 #define MATCHER_DEBUG
 
@@ -64,7 +70,10 @@ template <typename T>
 using Vector = std::vector<T>;
 
 /** enum used to tag match type. */
-enum MatchType { Literal, Copy };
+enum MatchType { Literal, Copy, RevComp, Approx };
+
+/** enum used to select hashing of positions covered by copies. */
+enum CopyInsert { InsertNone, InsertAll, InsertLimit };
 
 /** structure used to return matches. */
 template <typename Size>
@@ -92,11 +101,301 @@ static inline uint64_t prime_lt_pow2(int n)
     return (1ull << n) - k[n];
 }
 
+/** hash policy for byte symbols using a simple feedback shift xor hash. */
+template <typename Symbol, typename Size, bool Wide = (sizeof(Symbol) > 1)>
+struct MatcherHash
+{
+    static Size add(Size hval, Symbol symbol)
+    {
+        return (hval << 5) ^ symbol;
+    }
+};
+
+/** hash policy for wide symbols, multiply so all symbol bits diffuse. */
+template <typename Symbol, typename Size>
+struct MatcherHash<Symbol,Size,true>
+{
+    static Size add(Size hval, Symbol symbol)
+    {
+        /* shift xor would push most of a wide symbol out of the hash */
+        return (hval ^ Size(symbol)) * Size(0x9e3779b1);
+    }
+};
+
+/** complement of a nucleotide character, other symbols are unchanged. */
+static inline char complement(char c)
+{
+    switch (c) {
+    case 'A': return 'T';
+    case 'C': return 'G';
+    case 'G': return 'C';
+    case 'T': return 'A';
+    case 'a': return 't';
+    case 'c': return 'g';
+    case 'g': return 'c';
+    case 't': return 'a';
+    default: return c;
+    }
+}
+
+/** symbols without a complement are their own complement. */
+template <typename Symbol>
+Symbol complement(Symbol s)
+{
+    return s;
+}
+
+/** difference of two symbols for approximate copies. */
+template <typename Symbol>
+Symbol symbol_sub(Symbol a, Symbol b)
+{
+    return Symbol(a - b);
+}
+
+/** sum of a symbol and a difference for approximate copies. */
+template <typename Symbol>
+Symbol symbol_add(Symbol a, Symbol b)
+{
+    return Symbol(a + b);
+}
+
+/** symbol storage type, specialized for packed symbol types. */
+template <typename Symbol>
+struct MatcherStorage
+{
+    typedef Vector<Symbol> type;
+};
+
+/** return the length of the common prefix of two offsets up to limit. */
+template <typename Symbol>
+size_t match_length(const Vector<Symbol> &data, size_t a, size_t b,
+    size_t limit)
+{
+    size_t i = 0;
+    for (i = 0; i < limit; i++) {
+        if (data[a+i] != data[b+i]) break;
+    }
+    return i;
+}
+
+/** finalizer from murmur3 used to order k-mers by a random looking key. */
+static inline uint64_t hash_mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+/** gear hash table of random 64-bit values indexed by symbol byte. */
+static inline const uint64_t* gear_table()
+{
+    struct GearTable
+    {
+        uint64_t v[256];
+
+        GearTable()
+        {
+            /* splitmix64 sequence so the table is the same everywhere */
+            uint64_t x = 0;
+            for (size_t i = 0; i < 256; i++) {
+                uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                v[i] = z ^ (z >> 31);
+            }
+        }
+    };
+    static const GearTable table;
+    return table.v;
+}
+
+/**
+ * long distance matcher.
+ *
+ * A gear hash covers the last 64 symbols, and positions where its top
+ * rate bits are zero are content defined anchors, found at the same place
+ * in every copy of a repeat however far apart the copies are. Anchors go
+ * into a compact bucketed table spanning the whole input, and each anchor
+ * is looked up to find long matches ahead of the local search.
+ */
+template <typename Size>
+struct LongMatcher
+{
+    static const size_t kBucketSize = 4;
+
+    struct Entry { uint32_t check; Size pos; };
+    struct Long { size_t start; size_t offset; size_t length; };
+
+    size_t min_length = 0;
+    size_t rate = 7;
+    size_t table_bits = 18;
+
+    Vector<Entry> table;
+    uint64_t hval = 0;
+    size_t scan = 0;
+    size_t skip = 0;
+    Vector<Long> pending;
+    size_t pending_head = 0;
+
+    template <typename Storage>
+    void find(const Storage &data, size_t mark);
+
+    size_t next_start();
+    bool next(size_t mark, size_t &offset, size_t &length);
+};
+
+/** scan new data for anchors and queue long matches found at them. */
+template <typename Size>
+template <typename Storage>
+void LongMatcher<Size>::find(const Storage &data, size_t mark)
+{
+    const uint64_t *gear = gear_table();
+    size_t mask = (size_t(1) << table_bits) - 1;
+    if (table.size() == 0) table.resize(kBucketSize << table_bits);
+    if (skip < mark) skip = mark;
+
+    for (; scan < data.size(); scan++)
+    {
+        hval = (hval << 1) + gear[static_cast<uint64_t>(data[scan]) & 0xff];
+        if (scan + 1 < 64 || (hval >> (64 - rate)) != 0) continue;
+
+        Entry *bucket = &table[(hash_mix(hval) & mask) * kBucketSize];
+        uint32_t check = uint32_t(hval);
+
+        /* look up anchors at or after mark outside of earlier long matches */
+        size_t p = scan + 1;
+        if (p > skip) {
+            size_t best = 0, start = 0, len = 0;
+            for (size_t i = 0; i < kBucketSize; i++) {
+                if (bucket[i].check != check || bucket[i].pos == 0) continue;
+                size_t q = bucket[i].pos;
+                size_t f = match_length(data, q, p, data.size() - p), b = 0;
+                while (p - b > skip && q - b > 0 &&
+                    data[q - b - 1] == data[p - b - 1]) b++;
+                if (b + f > len) {
+                    best = q - b;
+                    start = p - b;
+                    len = b + f;
+                }
+            }
+            if (len >= min_length) {
+                pending.push_back({ start, best, len });
+                skip = start + len;
+            }
+        }
+
+        /* replace the oldest entry in the bucket */
+        memmove(bucket + 1, bucket, sizeof(Entry) * (kBucketSize - 1));
+        bucket[0] = { check, Size(p) };
+    }
+}
+
+/** return the start of the next queued long match. */
+template <typename Size>
+size_t LongMatcher<Size>::next_start()
+{
+    return pending_head < pending.size() ? pending[pending_head].start
+        : std::numeric_limits<size_t>::max();
+}
+
+/** return the queued long match at mark, trimming ones passed over. */
+template <typename Size>
+bool LongMatcher<Size>::next(size_t mark, size_t &offset, size_t &length)
+{
+    while (pending_head < pending.size()) {
+        Long &l = pending[pending_head];
+        if (l.start >= mark) break;
+        size_t delta = std::min(mark - l.start, l.length);
+        l.start += delta;
+        l.offset += delta;
+        l.length -= delta;
+        if (l.length == 0 || l.length < min_length / 2) pending_head++;
+    }
+    if (pending_head == pending.size()) {
+        pending.clear();
+        pending_head = 0;
+        return false;
+    }
+    if (pending[pending_head].start != mark) return false;
+    offset = pending[pending_head].offset;
+    length = pending[pending_head].length;
+    pending_head++;
+    return true;
+}
+
+/**
+ * (w,k)-minimizer sampler.
+ *
+ * Rolls a polynomial hash over k-mers and reports the position of the
+ * smallest k-mer key in each window of w consecutive k-mers, once per
+ * change of minimizer. Scanning resumes where it left off, so data may be
+ * sampled as it is appended.
+ */
+struct MinimizerSampler
+{
+    static const uint64_t kBase = 0x100000001b3ull;
+
+    struct Entry { uint64_t key; uint64_t hval; size_t pos; };
+
+    size_t w, k;
+    uint64_t hval, pow;
+    size_t next, last;
+    Vector<Entry> queue;
+    size_t queue_head;
+
+    MinimizerSampler() : w(0), k(16), hval(0), pow(1), next(0),
+        last(std::numeric_limits<size_t>::max()), queue(), queue_head(0) {}
+
+    template <typename Storage, typename Emit>
+    void scan(const Storage &data, Emit emit);
+};
+
+template <typename Storage, typename Emit>
+void MinimizerSampler::scan(const Storage &data, Emit emit)
+{
+    if (next == 0) {
+        pow = 1;
+        for (size_t i = 1; i < k; i++) pow *= kBase;
+    }
+
+    for (; next < data.size(); next++) {
+        /* roll the next symbol in and the symbol k back out */
+        if (next >= k) hval -= static_cast<uint64_t>(data[next - k]) * pow;
+        hval = hval * kBase + static_cast<uint64_t>(data[next]);
+        if (next + 1 < k) continue;
+
+        /* keep a queue of k-mers with increasing keys, oldest at head */
+        size_t pos = next + 1 - k;
+        uint64_t key = hash_mix(hval);
+        while (queue.size() > queue_head && queue.back().key > key) {
+            queue.pop_back();
+        }
+        queue.push_back({ key, hval, pos });
+        if (pos + 1 < w) continue;
+        while (queue[queue_head].pos + w <= pos) queue_head++;
+        if (queue_head > 1024 && queue_head * 2 > queue.size()) {
+            queue.erase(queue.begin(), queue.begin() + queue_head);
+            queue_head = 0;
+        }
+
+        /* report the window minimum when it changes */
+        const Entry &min = queue[queue_head];
+        if (min.pos != last) {
+            last = min.pos;
+            emit(min.pos, min.hval);
+        }
+    }
+}
+
 /** incremental matcher algorithm to find recurring substrings. */
 template <typename Symbol = char, typename Size = uint32_t>
 struct Matcher
 {
     static const size_t kInitialHashBits = 15;
+    static const size_t kMaxIndexBits = 26;
 
     size_t hash_bits;
     size_t hash_prime;
@@ -104,14 +403,42 @@ struct Matcher
 
     size_t min_match = 3;
     size_t max_match = 32;
+    size_t window = 0;
+    size_t window_start = 0;
+    size_t insert_stride = 1;
+    bool insert_after_copy = false;
+    CopyInsert copy_insert = InsertNone;
+    size_t max_insert_length = 32;
+    bool reverse = false;
+
+    MinimizerSampler sampler;
+    LongMatcher<Size> ldm;
+    Vector<Size> anchor_pos;
+    Vector<Size> anchor_next;
 
-    Vector<Symbol> data;
+    typename MatcherStorage<Symbol>::type data;
     Vector<Size> prev;
     Vector<Size> head;
     size_t mark;
 
+    Vector<Size> rc_prev;
+    Vector<Size> rc_head;
+    size_t rc_mark;
+
     Vector<Match<Size>> matches;
 
+    Vector<Symbol> deltas;
+    size_t approx_mark;
+    size_t approx_pos;
+
+    Vector<size_t> ref_offset;
+    size_t ref_end;
+    size_t ref_key = 8;
+    size_t ref_probe = 8;
+
+    size_t indexed = 0;
+    size_t index_shards = 64;
+
 #ifdef MATCHER_DEBUG
     size_t i1 = 0, i2 = 0;
 #endif
@@ -128,13 +455,50 @@ struct Matcher
     size_t hash_slot(Size hval);
     size_t check_match(size_t last, size_t pos);
 
-    void decompose(bool partition = true);
+    void rc_index();
+    void rc_insert(size_t p);
+    size_t rc_search(size_t &best);
+
+    void insert_copy(size_t offset, size_t length);
+
+    void push_literal(size_t offset, size_t length);
+    void push_copy(MatchType type, size_t offset, size_t length);
+
+    void decompose(bool partition = true,
+        size_t end = std::numeric_limits<size_t>::max());
+    void decompose_sampled(bool partition);
+    void decompose_indexed(bool partition, size_t end);
+    void decompose_speculative(size_t threads);
+    size_t indexed_step(size_t pos, size_t end, size_t &best,
+        size_t &probes) const;
+
+    void index_all(size_t threads);
+
+    void approximate(double max_mismatch);
+
+    template <typename Iterator>
+    size_t add_reference(Iterator begin, Iterator end);
+    void index_references(size_t threads);
+    size_t reference_of(size_t offset);
+    void split_references();
+
+    void slide(size_t n);
+    void reindex();
+    void rewind(size_t n, const Vector<Size> &saved_head);
+
+    template <typename Iterator>
+    void replace(size_t pos, size_t length, Iterator begin, Iterator end);
+    template <typename Iterator>
+    void insert(size_t pos, Iterator begin, Iterator end);
+    void erase(size_t pos, size_t length);
 };
 
 /** construct matcher instance with default hash table size. */
 template <typename Symbol, typename Size>
 Matcher<Symbol,Size>::Matcher(size_t hash_bits) : hash_bits(hash_bits),
-    data(), prev(), head(), mark(0), matches()
+    sampler(), ldm(), anchor_pos(), anchor_next(), data(), prev(), head(), mark(0),
+    rc_prev(), rc_head(), rc_mark(0), matches(), deltas(), approx_mark(0),
+    approx_pos(0), ref_offset(), ref_end(0)
 {
     resize(hash_bits);
 }
@@ -159,7 +523,9 @@ void Matcher<Symbol,Size>::append(Iterator begin, Iterator end)
         < std::numeric_limits<Size>::max());
 
     data.insert(data.end(), begin, end);
-    prev.resize(data.size());
+
+    /* sampled indexing keeps compact anchor chains instead of prev */
+    if (!sampler.w) prev.resize(data.size());
 }
 
 /** check whether a hashtable hit matches and return its total length. */
@@ -167,22 +533,24 @@ template <typename Symbol, typename Size>
 size_t Matcher<Symbol,Size>::check_match(size_t last, size_t pos)
 {
     /* exclude matches later in the string than us. */
-    if (last > mark + pos - min_match) return 0;
+    if (last + min_match > mark + pos) return 0;
+
+    /* exclude hash collisions that would start before the string. */
+    if (last < pos) return 0;
+
+    /* exclude matches starting before the window, if there is one. */
+    if (window && last - pos + window < mark) return 0;
+    if (last - pos < window_start) return 0;
 
     /* check past the end of the match up to the limit of available data. */
-    size_t i = 0, limit = data.size() - mark;
-    for (i = 0; i < limit; i++) {
-        if (data[last-pos+i] != data[mark+i]) break;
-    }
-    return i;
+    return match_length(data, last-pos, mark, data.size() - mark);
 }
 
 /** incrementally add a symbol to a hash value to form a new hash value. */
 template <typename Symbol, typename Size>
 Size Matcher<Symbol,Size>::hash_add(Size hval, Symbol symbol)
 {
-    /* simple feedback shift xor hash function */
-    return (hval << 5) ^ symbol;
+    return MatcherHash<Symbol,Size>::add(hval, symbol);
 }
 
 /** translate a hash value to a hash table slot using prime modulus. */
@@ -193,9 +561,123 @@ size_t Matcher<Symbol,Size>::hash_slot(Size hval)
     return hval % hash_prime;
 }
 
+/** index reverse complement k-mers of positions ending before mark. */
+template <typename Symbol, typename Size>
+void Matcher<Symbol,Size>::rc_index()
+{
+    if (rc_head.size() != hash_size) rc_head.resize(hash_size);
+    rc_prev.resize(data.size());
+
+    for (; rc_mark + min_match <= mark; rc_mark++) {
+        rc_insert(rc_mark);
+    }
+}
+
+/** hash the k-mer at p as it reads on the opposite strand. */
+template <typename Symbol, typename Size>
+void Matcher<Symbol,Size>::rc_insert(size_t p)
+{
+    Size hval = 0;
+    for (size_t i = min_match; i > 0; i--) {
+        hval = hash_add(hval, complement(data[p + i - 1]));
+    }
+    size_t hpos = hash_slot(hval);
+    rc_prev[p] = rc_head[hpos];
+    rc_head[hpos] = p;
+}
+
+/** find the longest reverse complement copy of data at mark. */
+template <typename Symbol, typename Size>
+size_t Matcher<Symbol,Size>::rc_search(size_t &best)
+{
+    if (mark + min_match > data.size()) return 0;
+
+    Size hval = 0;
+    for (size_t i = 0; i < min_match; i++) {
+        hval = hash_add(hval, data[mark + i]);
+    }
+
+    /*
+     * a candidate k-mer read backwards and complemented matches the data
+     * at mark, so extend backwards from its end while it still matches.
+     */
+    size_t len = 0;
+    size_t last = rc_head[hash_slot(hval)];
+    for (size_t steps = 0; last && steps < max_match; steps++) {
+        size_t end = last + min_match, i = 0;
+        /* k-mers past mark remain indexed while an edit is redone */
+        if (end <= mark && (!window || end + window >= mark)) {
+            size_t limit = std::min(end, data.size() - mark);
+            while (i < limit &&
+                data[mark + i] == complement(data[end - 1 - i])) i++;
+            if (i >= min_match && i > len) {
+                best = end - i;
+                len = i;
+            }
+        }
+
+        MATCHER_STATS_INCR(i2);
+
+        /* follow the hash chain if it is earlier */
+        last = rc_prev[last] < last ? rc_prev[last] : 0;
+    }
+    return len;
+}
+
+/** insert a single min_match hash for each position inside a copy. */
+template <typename Symbol, typename Size>
+void Matcher<Symbol,Size>::insert_copy(size_t offset, size_t length)
+{
+    /*
+     * Positions inside copies are skipped by the mark, so later matches
+     * that start inside them are missed. Hashing every prefix length at
+     * each position would cost O(len * max_match), so insert only the
+     * shortest prefix, which is enough to seed a lookup at min_match.
+     * Prefixes are keyed by their last symbol, and only prefixes that
+     * end inside the copy are inserted so slots past it are not shared.
+     */
+    if (copy_insert == InsertNone) return;
+    if (copy_insert == InsertLimit && length > max_insert_length) return;
+
+    for (size_t p = offset + 1; p + min_match <= offset + length; p++) {
+        Size hval = 0;
+        for (size_t i = 0; i < min_match; i++) {
+            hval = hash_add(hval, data[p + i]);
+        }
+        size_t hpos = hash_slot(hval), end = p + min_match - 1;
+        prev[end] = head[hpos];
+        head[hpos] = end;
+    }
+}
+
+/** add a literal instruction, extending the last literal if adjacent. */
+template <typename Symbol, typename Size>
+void Matcher<Symbol,Size>::push_literal(size_t offset, size_t length)
+{
+    if (length == 0) return;
+    if (matches.size() == 0 ||
+        matches.back().offset + matches.back().length != offset) {
+        matches.push_back({ MatchType::Literal, Size(offset), Size(length) });
+    } else {
+        matches.back().length += length;
+    }
+}
+
+/** add a copy instruction, replacing an empty partition literal. */
+template <typename Symbol, typename Size>
+void Matcher<Symbol,Size>::push_copy(MatchType type, size_t offset,
+    size_t length)
+{
+    if (matches.size() == 0 || matches.back().length > 0) {
+        matches.push_back({ type, Size(offset), Size(length) });
+    } else {
+        matches.back() = { type, Size(offset), Size(length) };
+    }
+}
+
 /** incrementally run the match algorithm on new data past mark. */
 template <typename Symbol, typename Size>
-void Matcher<Symbol,Size>::decompose(bool partition)
+void Matcher<Symbol,Size>::decompose(bool partition, size_t end)
 {
     /* 
      * Use the Rabin-Karp algorithm to find recurring substrings in a string
@@ -206,16 +688,56 @@ void Matcher<Symbol,Size>::decompose(bool partition)
      *
      * - Match[type=Literal] - create new literal from source.
      * - Match[type=Copy] - self referential copy from context.
+     * - Match[type=RevComp] - reverse complement copy from context.
+     *
+     * Instructions stop at end, which is used to redo part of the data.
      *
      * Complexity ~ O(n)
      */
 
-    if (partition && mark < data.size()) {
+    end = std::min(end, size_t(data.size()));
+
+    if (sampler.w) {
+        assert(end == data.size());
+        decompose_sampled(partition);
+        return;
+    }
+
+    if (indexed) {
+        decompose_indexed(partition, end);
+        return;
+    }
+
+    if (partition && mark < end) {
         matches.push_back({ MatchType::Literal, Size(mark), Size(0) });
     }
 
-    while (mark < data.size())
+    if (ldm.min_length) {
+        ldm.find(data, mark);
+    }
+
+    while (mark < end)
     {
+        /* long distance matches found ahead of the local search go first */
+        size_t ldm_offset, ldm_len;
+        if (ldm.min_length && ldm.next(mark, ldm_offset, ldm_len)) {
+            push_copy(MatchType::Copy, ldm_offset, ldm_len);
+            insert_copy(mark, ldm_len);
+            mark += ldm_len;
+            continue;
+        }
+
+        /*
+         * Sparse indexing only inserts hashes every stride positions, or
+         * after copies, but still looks up hashes at every position.
+         */
+        bool after_copy = matches.size() > 0 &&
+            matches.back().type != MatchType::Literal &&
+            matches.back().length > 0;
+        bool sparse = insert_stride > 1 || insert_after_copy;
+        bool insert = (insert_stride > 1 ? mark % insert_stride == 0 :
+            !insert_after_copy) || (insert_after_copy && after_copy);
+
         /* Use the Rabin-Karp algorithm to match substrings from our mark. */
         Size hval = 0;
         size_t limit = std::min(data.size() - mark, max_match);
@@ -228,8 +750,11 @@ void Matcher<Symbol,Size>::decompose(bool partition)
              */
             hval = hash_add(hval, data[mark + pos]);
             size_t hpos = hash_slot(hval);
-            size_t last = prev[mark + pos] = head[hpos];
-            head[hpos] = mark + pos;
+            size_t last = head[hpos];
+            if (insert) {
+                prev[mark + pos] = last;
+                head[hpos] = mark + pos;
+            }
 
             MATCHER_STATS_INCR(i1);
 
@@ -239,6 +764,7 @@ void Matcher<Symbol,Size>::decompose(bool partition)
              * check and follow hash table hits through chain matches to
              * find the best matches and save longer or earlier matches.
              */
+            size_t misses = 0;
             while (last) {
                 size_t match_len = check_match(last, pos);
                 if (match_len >= min_match &&
@@ -251,32 +777,875 @@ void Matcher<Symbol,Size>::decompose(bool partition)
 
                 MATCHER_STATS_INCR(i2);
 
-                /* follow the match hash chain if it is earlier */
-                last = match_len > pos && prev[last] < last ? prev[last] : 0;
+                /*
+                 * follow the match hash chain if it is earlier. chains into
+                 * references are probed past a few collisions, as they mix
+                 * with the prefixes of every length inserted by the target.
+                 */
+                bool follow = match_len > pos ||
+                    (ref_end && ++misses < ref_probe);
+                last = follow && prev[last] < last ? prev[last] : 0;
             }
 
             /* if hash table hit finds longer entry, we'll bail early. */
             if (len > pos + 1) break;
         }
 
+        /* optionally look for a longer copy from the opposite strand. */
+        MatchType type = MatchType::Copy;
+        if (reverse) {
+            size_t rc_best = 0;
+            rc_index();
+            size_t rc_len = rc_search(rc_best);
+            if (rc_len > len) {
+                type = MatchType::RevComp;
+                best = rc_best;
+                len = rc_len;
+            }
+        }
+
+        /* stop local copies short of the next long match and of end */
+        size_t ldm_start = ldm.min_length ? ldm.next_start() : 0, full = len;
+        if (ldm.min_length && mark + len > ldm_start &&
+            ldm_start - mark >= min_match) {
+            len = ldm_start - mark;
+        }
+        len = std::min(len, end - mark);
+
+        /* reverse complement copies keep the end of their source */
+        if (type == MatchType::RevComp) best += full - len;
+
+        /*
+         * a sparse index finds copies at an indexed position inside the
+         * repeat, so extend them backwards into the pending literal.
+         */
+        if (sparse && type == MatchType::Copy && len >= min_match &&
+            matches.size() > 0 && matches.back().type == MatchType::Literal)
+        {
+            auto &lit = matches.back();
+            while (lit.length > 0 && best > 0 &&
+                data[best - 1] == data[mark - 1]) {
+                lit.length--;
+                best--;
+                mark--;
+                len++;
+            }
+        }
+
         if (len >= min_match) {
-            mark += len;
             /* add copy instruction to list of matches. */
-            if (matches.size() == 0 || matches.back().length > 0) {
-                matches.push_back({ MatchType::Copy, Size(best), Size(len) });
-            } else {
-                matches.back() = { MatchType::Copy, Size(best), Size(len) };
+            push_copy(type, best, len);
+            insert_copy(mark, len);
+            mark += len;
+        } else {
+            /* add new literal instruction and advance mark by one. */
+            push_literal(mark, 1);
+            mark++;
+        }
+    }
+}
+
+/** run the match algorithm seeding matches from minimizer anchors. */
+template <typename Symbol, typename Size>
+void Matcher<Symbol,Size>::decompose_sampled(bool partition)
+{
+    /*
+     * Only positions whose k-mer is the minimum of its window are indexed,
+     * in compact anchor chains hanging off head. Repeats share minimizers,
+     * so each anchor is looked up in the chains for earlier occurrences of
+     * its k-mer, which are extended forwards and backwards to the mark.
+     */
+
+    if (partition && mark < data.size()) {
+        matches.push_back({ MatchType::Literal, Size(mark), Size(0) });
+    }
+
+    sampler.scan(data, [&](size_t q, uint64_t hval)
+    {
+        size_t hpos = hash_mix(hval) % hash_prime;
+
+        if (q >= mark) {
+            size_t best = 0, start = 0, len = 0;
+            size_t idx = head[hpos];
+            for (size_t steps = 0; idx && steps < max_match; steps++) {
+                size_t s = anchor_pos[idx - 1];
+                idx = anchor_next[idx - 1];
+                if (window && s + window < q) continue;
+
+                MATCHER_STATS_INCR(i2);
+
+                /* verify the seed and extend it forwards then backwards */
+                size_t f = match_length(data, s, q, data.size() - q);
+                if (f < sampler.k) continue;
+                size_t b = 0;
+                while (b < q - mark && b < s && data[s-b-1] == data[q-b-1]) {
+                    b++;
+                }
+                if (b + f > len) {
+                    best = s - b;
+                    start = q - b;
+                    len = b + f;
+                }
             }
+            if (len >= min_match) {
+                push_literal(mark, start - mark);
+                push_copy(MatchType::Copy, best, len);
+                mark = start + len;
+            }
+        }
+
+        /* anchors are linked after lookup so a k-mer cannot match itself */
+        anchor_pos.push_back(Size(q));
+        anchor_next.push_back(head[hpos]);
+        head[hpos] = Size(anchor_pos.size());
+
+        MATCHER_STATS_INCR(i1);
+    });
+
+    push_literal(mark, data.size() - mark);
+    mark = data.size();
+}
+
+/** index the key at every position of the data in parallel. */
+template <typename Symbol, typename Size>
+void Matcher<Symbol,Size>::index_all(size_t threads)
+{
+    /*
+     * Offline alternative to hashing as decompose goes. Workers hash the
+     * min_match prefix at each position of their range and count them per
+     * shard, where a shard is a range of the high bits of the slot. After
+     * a prefix sum each worker scatters its positions into a partitioned
+     * array, keeping them in position order within each shard. The shards
+     * own disjoint slots, so each is then chained by one worker, linking
+     * every position through prev to the earlier positions with the same
+     * slot. The parse only reads prev.
+     */
+    assert(mark == 0 && !sampler.w && !ldm.min_length && !reverse);
+
+    size_t n = data.size(), key = std::min(min_match, max_match);
+    size_t count = n >= key + 1 ? n - key : 0;
+    threads = std::max(threads, size_t(1));
+
+    /* every position is indexed, so size the table to keep chains short */
+    size_t bits = 0;
+    while (bits < kMaxIndexBits && (size_t(1) << bits) < count) bits++;
+    if ((size_t(1) << bits) > hash_size) resize(bits);
+
+    size_t shards = std::max(index_shards, size_t(1)), shift = 0;
+    while ((hash_size >> shift) > shards) shift++;
+    shards = ((hash_size - 1) >> shift) + 1;
+
+    Vector<Size> slots(n), part(count);
+    Vector<Vector<size_t>> offset(threads, Vector<size_t>(shards));
+    auto range = [&](size_t t) {
+        return std::make_pair(1 + count * t / threads,
+            1 + count * (t + 1) / threads);
+    };
+    auto parallel = [threads](std::function<void(size_t)> f) {
+        std::vector<std::thread> pool;
+        for (size_t t = 1; t < threads; t++) pool.emplace_back(f, t);
+        f(0);
+        for (auto &t : pool) t.join();
+    };
+
+    parallel([&](size_t t) {
+        auto r = range(t);
+        for (size_t p = r.first; p < r.second; p++) {
+            Size hval = 0;
+            for (size_t i = 0; i < key; i++) {
+                hval = hash_add(hval, data[p + i]);
+            }
+            slots[p] = Size(hash_slot(hval));
+            offset[t][slots[p] >> shift]++;
+        }
+    });
+
+    Vector<size_t> shard_begin(shards + 1);
+    size_t sum = 0;
+    for (size_t s = 0; s < shards; s++) {
+        shard_begin[s] = sum;
+        for (size_t t = 0; t < threads; t++) {
+            size_t c = offset[t][s];
+            offset[t][s] = sum;
+            sum += c;
+        }
+    }
+    shard_begin[shards] = sum;
+
+    parallel([&](size_t t) {
+        auto r = range(t);
+        for (size_t p = r.first; p < r.second; p++) {
+            part[offset[t][slots[p] >> shift]++] = Size(p);
+        }
+    });
+
+    std::atomic<size_t> next(0);
+    parallel([&](size_t) {
+        size_t s;
+        while ((s = next++) < shards) {
+            for (size_t i = shard_begin[s]; i < shard_begin[s + 1]; i++) {
+                size_t p = part[i], hpos = slots[p];
+                prev[p] = head[hpos];
+                head[hpos] = Size(p);
+            }
+        }
+    });
+
+    indexed = count + 1;
+}
+
+/** return the longest indexed copy at pos ending by end, or zero. */
+template <typename Symbol, typename Size>
+size_t Matcher<Symbol,Size>::indexed_step(size_t pos, size_t end,
+    size_t &best, size_t &probes) const
+{
+    /*
+     * prev of the key at pos chains back through the earlier positions
+     * with the same slot, so each candidate is verified and extended and
+     * the longest becomes a copy. Keys past the end of the index are not
+     * looked up. Only the data and the index are read.
+     */
+    size_t len = 0;
+    size_t last = pos < indexed ? prev[pos] : 0;
+    for (size_t steps = 0; last && steps < max_match; steps++) {
+        if (window && last + window < pos) break;
+        size_t match_len = match_length(data, last, pos, data.size() - pos);
+        if (match_len > len) {
+            best = last;
+            len = match_len;
+        }
+        probes++;
+        last = prev[last] < last ? prev[last] : 0;
+    }
+    len = std::min(len, end - pos);
+    return len >= min_match ? len : 0;
+}
+
+/** run a greedy parse that only looks up the index built by index_all. */
+template <typename Symbol, typename Size>
+void Matcher<Symbol,Size>::decompose_indexed(bool partition, size_t end)
+{
+    if (partition && mark < end) {
+        matches.push_back({ MatchType::Literal, Size(mark), Size(0) });
+    }
+
+    size_t probes = 0;
+    while (mark < end)
+    {
+        size_t best = 0, len = indexed_step(mark, end, best, probes);
+
+        MATCHER_STATS_INCR(i1);
+
+        if (len) {
+            push_copy(MatchType::Copy, best, len);
+            mark += len;
         } else {
-            /* add new literal instruction if required. */
-            if (matches.size() == 0 ||
-                matches.back().offset + matches.back().length != mark) {
-                matches.push_back({ MatchType::Literal, Size(mark), Size(1) });
+            push_literal(mark, 1);
+            mark++;
+        }
+    }
+#ifdef MATCHER_DEBUG
+    i2 += probes;
+#endif
+}
+
+/** run the indexed parse on blocks in parallel, stitching where they meet. */
+template <typename Symbol, typename Size>
+void Matcher<Symbol,Size>::decompose_speculative(size_t threads)
+{
+    /*
+     * The greedy parse from a position only depends on that position, so
+     * parses started anywhere agree from the first position where both
+     * start an instruction. Each worker parses its block from a guessed
+     * boundary to the first instruction start at or past the block end.
+     * Then each worker carries its parse on past its end until it reaches
+     * a position where the parse of a later block starts an instruction,
+     * which is usually within a few instructions. Stitching the parse of
+     * block 0 to the later blocks at those points gives exactly the serial
+     * parse. Extensions only read the first pass of other blocks, and
+     * go into their own vectors so the first pass is not written while
+     * other workers read it.
+     */
+    assert(indexed && mark == 0 && matches.empty());
+
+    struct Block
+    {
+        size_t begin, end, sync;
+        Vector<Match<Size>> steps;      /* first pass: type, offset, length */
+        Vector<size_t> starts;          /* output position of each step */
+        Vector<Match<Size>> ext;        /* steps of the extension past end */
+        Vector<size_t> ext_starts;
+        size_t next;                    /* block the parse continues in */
+        size_t probes;
+    };
+
+    size_t n = data.size();
+    threads = std::max(size_t(1), std::min(threads, n / 1024 + 1));
+    Vector<Block> blocks(threads);
+
+    auto step = [&](Vector<Match<Size>> &steps, Vector<size_t> &starts,
+        size_t &probes, size_t pos) {
+        size_t best = 0, len = indexed_step(pos, n, best, probes);
+        if (len) {
+            steps.push_back({ MatchType::Copy, Size(best), Size(len) });
+        } else if (steps.size() > 0 &&
+            steps.back().type == MatchType::Literal &&
+            starts.back() + steps.back().length == pos) {
+            steps.back().length++;
+            return pos + 1;
+        } else {
+            steps.push_back({ MatchType::Literal, Size(pos), Size(1) });
+        }
+        starts.push_back(pos);
+        return pos + std::max(len, size_t(1));
+    };
+
+    /* true if the first pass of block u starts a step at pos */
+    auto starts_step = [&](const Block &u, size_t pos) {
+        auto i = std::upper_bound(u.starts.begin(), u.starts.end(), pos);
+        if (i == u.starts.begin()) return false;
+        size_t k = i - u.starts.begin() - 1;
+        const Match<Size> &m = u.steps[k];
+        return m.type == MatchType::Literal ?
+            pos < u.starts[k] + m.length : pos == u.starts[k];
+    };
+
+    auto parallel = [threads](std::function<void(size_t)> f) {
+        std::vector<std::thread> pool;
+        for (size_t t = 1; t < threads; t++) pool.emplace_back(f, t);
+        f(0);
+        for (auto &t : pool) t.join();
+    };
+
+    parallel([&](size_t t) {
+        Block &b = blocks[t];
+        b.begin = n * t / threads;
+        size_t limit = n * (t + 1) / threads, pos = b.begin;
+        b.probes = 0;
+        while (pos < limit) pos = step(b.steps, b.starts, b.probes, pos);
+        b.end = pos;
+    });
+
+    parallel([&](size_t t) {
+        Block &b = blocks[t];
+        size_t pos = b.end, u = t + 1;
+        while (pos < n) {
+            while (u < threads && pos >= blocks[u].end) u++;
+            if (u == threads || starts_step(blocks[u], pos)) break;
+            pos = step(b.ext, b.ext_starts, b.probes, pos);
+        }
+        b.sync = pos;
+        b.next = u;
+    });
+
+    /* follow block 0 and jump to the block where each parse synced */
+    size_t t = 0, from = 0, probes = 0;
+    for (;;) {
+        Block &b = blocks[t];
+        probes += b.probes;
+        size_t pos = b.begin, count = b.steps.size() + b.ext.size();
+        for (size_t k = 0; k < count && pos < b.sync; k++) {
+            const Match<Size> &m = k < b.steps.size() ? b.steps[k] :
+                b.ext[k - b.steps.size()];
+            size_t end = pos + m.length;
+            if (end > from) {
+                if (m.type == MatchType::Literal) {
+                    size_t a = std::max(pos, from);
+                    size_t e = std::min(end, b.sync);
+                    push_literal(a, e - a);
+                } else {
+                    assert(pos >= from);
+                    push_copy(m.type, m.offset, m.length);
+                }
+            }
+            pos = end;
+        }
+        if (b.next == threads || b.sync >= n) break;
+        from = b.sync;
+        t = b.next;
+    }
+    mark = n;
+#ifdef MATCHER_DEBUG
+    i1 += matches.size();
+    i2 += probes;
+#endif
+}
+
+/** extend copies over small differences into approximate copies. */
+template <typename Symbol, typename Size>
+void Matcher<Symbol,Size>::approximate(double max_mismatch)
+{
+    /*
+     * Small shifts such as pointers and counters in binaries break exact
+     * copies into short runs with the same distance. Like bsdiff, extend
+     * each copy forward with its own distance to the length that scores
+     * best, counting matches as +1 and mismatches as -1, as long as the
+     * mismatch rate stays below the threshold. The extended copy becomes
+     * an Approx instruction whose target minus source differences are
+     * appended to deltas, and instructions it covers are trimmed.
+     *
+     * - Match[type=Approx] - copy from context plus next length deltas.
+     */
+    static const ptrdiff_t kSlack = 64;
+
+    Vector<Match<Size>> out(matches.begin(), matches.begin() + approx_mark);
+    size_t t = approx_pos, covered = approx_pos;
+
+    for (size_t i = approx_mark; i < matches.size(); i++)
+    {
+        Match<Size> n = matches[i];
+        size_t end = t + n.length;
+        t = end;
+        if (end < covered || (end == covered && n.length > 0)) continue;
+
+        /*
+         * trim the front of instructions partly covered by an extension,
+         * reverse complements read their source from the end so keep it.
+         */
+        size_t trim = covered > end - n.length ? covered - (end - n.length) : 0;
+        if (n.type != MatchType::RevComp) n.offset += Size(trim);
+        n.length -= Size(trim);
+
+        if (n.type != MatchType::Copy || n.length == 0) {
+            if (n.type == MatchType::Literal && n.length > 0 &&
+                out.size() > 0 && out.back().type == MatchType::Literal &&
+                out.back().offset + out.back().length == n.offset) {
+                out.back().length += n.length;
             } else {
-                matches.back().length++;
+                out.push_back(n);
             }
-            /* advance mark by one. */
-            mark++;
+            covered = end;
+            continue;
+        }
+
+        /* score forward extensions with the distance of this copy */
+        size_t dist = end - n.length - n.offset;
+        ptrdiff_t score = 0, best_score = 0;
+        size_t best_ext = 0, mismatches = 0, best_mismatches = 0;
+        for (size_t j = end; j < data.size(); j++) {
+            if (data[j] == data[j - dist]) {
+                score++;
+            } else {
+                score--;
+                mismatches++;
+            }
+            if (score > best_score && double(mismatches) <=
+                max_mismatch * double(j + 1 - end + n.length)) {
+                best_score = score;
+                best_ext = j + 1 - end;
+                best_mismatches = mismatches;
+            }
+            if (score < best_score - kSlack) break;
+
+            MATCHER_STATS_INCR(i2);
         }
+
+        if (best_mismatches > 0) {
+            n.type = MatchType::Approx;
+            for (size_t j = 0; j < n.length + best_ext; j++) {
+                size_t k = end - n.length + j;
+                deltas.push_back(symbol_sub(data[k], data[k - dist]));
+            }
+        }
+        n.length += Size(best_ext);
+        out.push_back(n);
+        covered = end + best_ext;
     }
+
+    matches = out;
+    approx_mark = matches.size();
+    approx_pos = covered;
+}
+
+/** append reference data to be indexed but not decomposed. */
+template <typename Symbol, typename Size>
+template <typename Iterator>
+size_t Matcher<Symbol,Size>::add_reference(Iterator begin, Iterator end)
+{
+    assert(mark == data.size());
+    ref_offset.push_back(data.size());
+    append(begin, end);
+    mark = data.size();
+    return ref_offset.size() - 1;
+}
+
+/** index all references into head and prev in parallel. */
+template <typename Symbol, typename Size>
+void Matcher<Symbol,Size>::index_references(size_t threads)
+{
+    /*
+     * Each reference is hashed by a worker into its own head table with
+     * chains in its own disjoint range of prev, recording the oldest entry
+     * of each chain. The chains are then spliced onto the shared head in
+     * reference order, so the result is one combined table with the same
+     * chains a serial build would have produced.
+     *
+     * Each position is keyed once by its ref_key prefix, which a lookup
+     * finds at that prefix length, so chains are not clobbered by the
+     * other prefix lengths and stay short enough to walk.
+     */
+    size_t nrefs = ref_offset.size(), key = std::min(ref_key, max_match);
+    Vector<Vector<Size>> ref_head(nrefs), ref_tail(nrefs);
+    std::atomic<size_t> next(0);
+
+    auto worker = [&]() {
+        size_t r;
+        while ((r = next++) < nrefs) {
+            size_t begin = ref_offset[r];
+            size_t end = r + 1 < nrefs ? ref_offset[r + 1] : mark;
+            Vector<Size> &lhead = ref_head[r], &ltail = ref_tail[r];
+            lhead.assign(hash_size, 0);
+            ltail.assign(hash_size, 0);
+            for (size_t p = std::max(begin, size_t(1)); p + key <= end; p++) {
+                Size hval = 0;
+                for (size_t i = 0; i < key; i++) {
+                    hval = hash_add(hval, data[p + i]);
+                }
+                size_t hpos = hash_slot(hval), last = p + key - 1;
+                prev[last] = lhead[hpos];
+                lhead[hpos] = last;
+                if (!ltail[hpos]) ltail[hpos] = last;
+            }
+        }
+    };
+    ref_end = mark;
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; t++) pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool) t.join();
+
+    for (size_t r = 0; r < nrefs; r++) {
+        for (size_t hpos = 0; hpos < hash_size; hpos++) {
+            if (!ref_head[r][hpos]) continue;
+            prev[ref_tail[r][hpos]] = head[hpos];
+            head[hpos] = ref_head[r][hpos];
+        }
+        Vector<Size>().swap(ref_head[r]);
+        Vector<Size>().swap(ref_tail[r]);
+    }
+}
+
+/** return the reference containing offset, or the count if past them. */
+template <typename Symbol, typename Size>
+size_t Matcher<Symbol,Size>::reference_of(size_t offset)
+{
+    return std::upper_bound(ref_offset.begin(), ref_offset.end(), offset)
+        - ref_offset.begin() - 1;
+}
+
+/** split copies whose source crosses from one reference into the next. */
+template <typename Symbol, typename Size>
+void Matcher<Symbol,Size>::split_references()
+{
+    if (ref_offset.size() == 0) return;
+
+    Vector<size_t> bounds(ref_offset.begin() + 1, ref_offset.end());
+    bounds.push_back(ref_end);
+
+    Vector<Match<Size>> out;
+    for (auto n : matches) {
+        if (n.type != MatchType::Copy && n.type != MatchType::RevComp) {
+            out.push_back(n);
+            continue;
+        }
+        size_t end = n.offset + n.length;
+        auto lo = std::upper_bound(bounds.begin(), bounds.end(),
+            size_t(n.offset));
+        auto hi = std::lower_bound(lo, bounds.end(), end);
+        if (n.type == MatchType::Copy) {
+            for (auto b = lo; b != hi; b++) {
+                out.push_back({ n.type, n.offset, Size(*b - n.offset) });
+                n.length -= Size(*b - n.offset);
+                n.offset = Size(*b);
+            }
+        } else {
+            /* reverse complement copies read their source from the end */
+            for (auto b = hi; b != lo; b--) {
+                out.push_back({ n.type, Size(b[-1]), Size(end - b[-1]) });
+                end = b[-1];
+            }
+            n.length = Size(end - n.offset);
+        }
+        out.push_back(n);
+    }
+    matches = out;
+}
+
+/** evict the first n symbols, rebasing the index and instructions. */
+template <typename Symbol, typename Size>
+void Matcher<Symbol,Size>::slide(size_t n)
+{
+    /*
+     * Positions are rebased by n and chain entries into evicted data are
+     * cut to zero, which ends the chain. Instructions for evicted data are
+     * dropped and copies whose source was evicted become literals, so the
+     * remaining instructions still decode the remaining data. n must fall
+     * on an instruction boundary at or before mark.
+     *
+     * Positions inside copies are not indexed, so once a copy becomes the
+     * only remaining instance of its data the chains are rebuilt.
+     */
+    assert(n <= mark && !sampler.w && !ldm.min_length && deltas.empty());
+    if (n == 0) return;
+
+    auto rebase = [n](Size v) { return v >= n ? Size(v - n) : Size(0); };
+
+    data.erase(data.begin(), data.begin() + n);
+    prev.erase(prev.begin(), prev.begin() + n);
+    for (auto &v : prev) v = rebase(v);
+    for (auto &v : head) v = rebase(v);
+    if (rc_mark) {
+        rc_prev.erase(rc_prev.begin(), rc_prev.begin() + n);
+        for (auto &v : rc_prev) v = rebase(v);
+        for (auto &v : rc_head) v = rebase(v);
+        rc_mark = rc_mark > n ? rc_mark - n : 0;
+    }
+    mark -= n;
+    window_start = window_start > n ? window_start - n : 0;
+
+    Vector<Match<Size>> out;
+    size_t pos = 0;
+    bool converted = false;
+    for (auto m : matches) {
+        size_t start = pos;
+        pos += m.length;
+        if (start < n) {
+            assert(pos <= n);
+            continue;
+        }
+        start -= n;
+        if (m.type == MatchType::Literal) {
+            out.push_back({ m.type, Size(start), m.length });
+            continue;
+        }
+        converted |= m.offset < n;
+        if (m.type == MatchType::Copy && m.offset < n) {
+            /* the evicted head of the source becomes a literal */
+            size_t lost = std::min(size_t(m.length), n - m.offset);
+            out.push_back({ MatchType::Literal, Size(start), Size(lost) });
+            if (m.length > lost) {
+                out.push_back({ m.type, Size(0), Size(m.length - lost) });
+            }
+        } else if (m.offset < n) {
+            out.push_back({ MatchType::Literal, Size(start), m.length });
+        } else {
+            out.push_back({ m.type, Size(m.offset - n), m.length });
+        }
+    }
+    matches = out;
+    approx_mark = matches.size();
+    approx_pos = mark;
+
+    if (converted) reindex();
+}
+
+/** rebuild the hash chains for data before mark from the instructions. */
+template <typename Symbol, typename Size>
+void Matcher<Symbol,Size>::reindex()
+{
+    /* literals hash every prefix from each position, as decompose does */
+    std::fill(head.begin(), head.end(), Size(0));
+    std::fill(prev.begin(), prev.end(), Size(0));
+    size_t pos = 0;
+    for (auto &n : matches) {
+        if (n.type != MatchType::Literal) {
+            insert_copy(pos, n.length);
+            pos += n.length;
+            continue;
+        }
+        for (size_t end = pos + n.length; pos < end; pos++) {
+            Size hval = 0;
+            size_t limit = std::min(mark - pos, max_match);
+            for (size_t i = 0; i < limit; i++) {
+                hval = hash_add(hval, data[pos + i]);
+                size_t hpos = hash_slot(hval);
+                prev[pos + i] = head[hpos];
+                head[hpos] = pos + i;
+            }
+        }
+    }
+}
+
+/** discard data past n, restoring the head saved when the data ended at n. */
+template <typename Symbol, typename Size>
+void Matcher<Symbol,Size>::rewind(size_t n, const Vector<Size> &saved_head)
+{
+    /*
+     * Chain entries before n are never written again once mark passes
+     * them, so truncating prev and restoring head undoes everything
+     * decompose did past n, without rehashing the data before it. This
+     * lets a matcher primed with references be reused across inputs.
+     * An empty saved head clears the table.
+     */
+    assert(n <= mark && !sampler.w && !ldm.min_length);
+
+    data.resize(n);
+    prev.resize(n);
+    if (saved_head.size() == head.size()) {
+        std::copy(saved_head.begin(), saved_head.end(), head.begin());
+    } else {
+        std::fill(head.begin(), head.end(), Size(0));
+    }
+    if (rc_mark) {
+        rc_prev.clear();
+        std::fill(rc_head.begin(), rc_head.end(), Size(0));
+        rc_mark = 0;
+    }
+    mark = n;
+    matches.clear();
+    deltas.clear();
+    approx_mark = 0;
+    approx_pos = n;
+}
+
+/** replace length symbols at pos, redoing only the affected instructions. */
+template <typename Symbol, typename Size>
+template <typename Iterator>
+void Matcher<Symbol,Size>::replace(size_t pos, size_t length,
+    Iterator begin, Iterator end)
+{
+    /*
+     * The symbols are patched in place and positions past the edit are
+     * rebased, with chain entries into the removed symbols cut to zero.
+     * Instructions before the edit are kept, the instruction containing
+     * the edit is truncated, and the data from the edit up to the next
+     * old instruction boundary is decomposed again. The old instructions
+     * after it are then spliced back, rebased, except for copies whose
+     * source overlapped the edit, which are decomposed again in place.
+     *
+     * Stale hashes of prefixes that cross the edit are left in the chains,
+     * as check_match compares the symbols of every candidate.
+     */
+    assert(mark == data.size() && pos + length <= mark);
+    assert(!sampler.w && !ldm.min_length && deltas.empty() &&
+        ref_offset.empty());
+
+    size_t count = std::distance(begin, end), stop = pos + length;
+    size_t old_size = data.size();
+    auto shift = [&](size_t v) -> Size {
+        return v < pos ? Size(v) : Size(v + count - length);
+    };
+    auto rebase = [&](size_t v) -> Size {
+        return v == 0 || v < pos ? Size(v) : v >= stop ? shift(v) : Size(0);
+    };
+
+    data.erase(data.begin() + pos, data.begin() + stop);
+    data.insert(data.begin() + pos, begin, end);
+    prev.erase(prev.begin() + pos, prev.begin() + stop);
+    prev.insert(prev.begin() + pos, count, Size(0));
+    for (auto &v : prev) v = rebase(v);
+    for (auto &v : head) v = rebase(v);
+
+    /* reverse complement k-mers are indexed at their start up to rc_mark */
+    if (rc_mark) {
+        rc_prev.resize(old_size);
+        rc_prev.erase(rc_prev.begin() + pos, rc_prev.begin() + stop);
+        rc_prev.insert(rc_prev.begin() + pos, count, Size(0));
+        for (auto &v : rc_prev) v = rebase(v);
+        for (auto &v : rc_head) v = rebase(v);
+        size_t rc_end = rc_mark > stop ? rebase(rc_mark) : std::min(rc_mark, pos);
+        size_t p = pos > min_match - 1 ? pos - (min_match - 1) : 0;
+        for (; p < pos + count && p < rc_end; p++) {
+            if (p + min_match <= data.size()) rc_insert(p);
+        }
+        rc_mark = rc_end;
+    }
+
+    /* keep instructions that end before the edit */
+    size_t k = 0, at = 0;
+    while (k < matches.size() && at + matches[k].length <= pos) {
+        at += matches[k++].length;
+    }
+    Vector<Match<Size>> tail(matches.begin() + k, matches.end());
+    matches.resize(k);
+
+    /* truncate the instruction containing the edit */
+    if (tail.size() > 0 && at < pos) {
+        Match<Size> n = tail[0];
+        size_t keep = pos - at;
+        if (n.type == MatchType::RevComp) n.offset += n.length - keep;
+        n.length = Size(keep);
+        matches.push_back(n);
+    }
+
+    /* skip old instructions up to the first boundary past the edit */
+    size_t t = 0;
+    while (t < tail.size() && at < stop) at += tail[t++].length;
+
+    mark = pos;
+    decompose(false, at + count - length);
+
+    for (; t < tail.size(); t++) {
+        Match<Size> n = tail[t];
+        size_t from = at + count - length;
+        at += n.length;
+        if (n.type == MatchType::Literal) {
+            matches.push_back({ n.type, Size(from), n.length });
+        } else if (n.offset + n.length <= pos || n.offset >= stop) {
+            matches.push_back({ n.type, shift(n.offset), n.length });
+        } else {
+            mark = from;
+            decompose(false, from + n.length);
+        }
+    }
+    mark = data.size();
+    approx_mark = matches.size();
+    approx_pos = mark;
+}
+
+/** insert symbols at pos. */
+template <typename Symbol, typename Size>
+template <typename Iterator>
+void Matcher<Symbol,Size>::insert(size_t pos, Iterator begin, Iterator end)
+{
+    replace(pos, 0, begin, end);
+}
+
+/** erase length symbols at pos. */
+template <typename Symbol, typename Size>
+void Matcher<Symbol,Size>::erase(size_t pos, size_t length)
+{
+    const Symbol *none = nullptr;
+    replace(pos, length, none, none);
+}
+
+/** reconstruct symbols, with approximate copies adding deltas in order. */
+template <typename Source, typename Delta, typename Symbol, typename Size>
+void decode(const Vector<Match<Size>> &matches, const Source &source,
+    const Delta &deltas, Vector<Symbol> &out)
+{
+    size_t d = 0;
+    for (auto &n : matches) {
+        switch (n.type) {
+        case MatchType::Literal:
+            for (size_t i = 0; i < n.length; i++) {
+                out.push_back(Symbol(source[n.offset + i]));
+            }
+            break;
+        case MatchType::Copy:
+            /* copies may overlap their own output so copy forwards */
+            for (size_t i = 0; i < n.length; i++) {
+                out.push_back(out[n.offset + i]);
+            }
+            break;
+        case MatchType::RevComp:
+            for (size_t i = 0; i < n.length; i++) {
+                out.push_back(complement(out[n.offset + n.length - 1 - i]));
+            }
+            break;
+        case MatchType::Approx:
+            for (size_t i = 0; i < n.length; i++) {
+                out.push_back(symbol_add(out[n.offset + i], deltas[d++]));
+            }
+            break;
+        }
+    }
+}
+
+/** reconstruct symbols from matches with literals read from source. */
+template <typename Source, typename Symbol, typename Size>
+void decode(const Vector<Match<Size>> &matches, const Source &source,
+    Vector<Symbol> &out)
+{
+    decode(matches, source, Vector<Symbol>(), out);
 }
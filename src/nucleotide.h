@@ -0,0 +1,236 @@
+/*
+ * Nucleotide
+ *
+ * 2-bit packed nucleotide storage for the matcher.
+ *
+ * Copyright (c) 2020, Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include "matcher.h"
+
+/** nucleotide symbol holding its character, A, C, G, T or other. */
+enum class Base : char {};
+
+/** 2-bit code for a base of either case: A=0, C=1, G=2, T=3, or -1. */
+static inline int base_code(char c)
+{
+    switch (c) {
+    case 'A': case 'a': return 0;
+    case 'C': case 'c': return 1;
+    case 'G': case 'g': return 2;
+    case 'T': case 't': return 3;
+    default: return -1;
+    }
+}
+
+/** complement of a base, other symbols are unchanged. */
+static inline Base complement(Base b)
+{
+    return Base(complement(char(b)));
+}
+
+/** difference of the characters of two bases. */
+static inline Base symbol_sub(Base a, Base b)
+{
+    return Base(char(a) - char(b));
+}
+
+/** sum of the characters of a base and a difference. */
+static inline Base symbol_add(Base a, Base b)
+{
+    return Base(char(a) + char(b));
+}
+
+/** run of symbols that are not A, C, G or T, such as N. */
+struct BaseRun
+{
+    size_t offset;
+    size_t length;
+    char symbol;
+};
+
+/** run of lower case bases, as in soft-masked sequences. */
+struct CaseRun
+{
+    size_t offset;
+    size_t length;
+};
+
+/**
+ * bases packed 32 per 64-bit word with side lists of other symbols and
+ * of lower case bases, so that case is folded in the packed words and
+ * the hash while the exact symbols are still kept.
+ */
+struct PackedBases
+{
+    Vector<uint64_t> words;
+    Vector<BaseRun> runs;
+    Vector<CaseRun> lower;
+    size_t count;
+
+    PackedBases() : words(2), runs(), lower(), count(0) {}
+
+    size_t size() const { return count; }
+    size_t end() const { return count; }
+
+    template <typename Iterator>
+    void insert(size_t pos, Iterator begin, Iterator end);
+
+    Base operator[](size_t i) const;
+    uint64_t word_at(size_t i) const;
+    size_t next_run(size_t i) const;
+    size_t case_span(size_t i, bool &is_lower) const;
+};
+
+/** append bases, assumes insertion at the end of the sequence. */
+template <typename Iterator>
+void PackedBases::insert(size_t pos, Iterator begin, Iterator end)
+{
+    assert(pos == count);
+
+    /* keep a spare word past the end so word_at can read unaligned */
+    words.resize((count + std::distance(begin, end)) / 32 + 2);
+    for (Iterator i = begin; i != end; i++, count++) {
+        char c = char(*i);
+        int code = base_code(c);
+        if (code < 0) {
+            /* other symbols are stored as A and recorded in a run */
+            if (runs.size() > 0 && runs.back().symbol == c &&
+                runs.back().offset + runs.back().length == count) {
+                runs.back().length++;
+            } else {
+                runs.push_back({ count, 1, c });
+            }
+            code = 0;
+        } else if (c >= 'a') {
+            if (lower.size() > 0 &&
+                lower.back().offset + lower.back().length == count) {
+                lower.back().length++;
+            } else {
+                lower.push_back({ count, 1 });
+            }
+        }
+        words[count >> 5] |= uint64_t(code) << ((count & 31) << 1);
+    }
+}
+
+/** return the index of the first run ending past offset i. */
+inline size_t PackedBases::next_run(size_t i) const
+{
+    return std::upper_bound(runs.begin(), runs.end(), i,
+        [](size_t i, const BaseRun &r) { return i < r.offset + r.length; })
+        - runs.begin();
+}
+
+/** return the number of bases from offset i with the same case as i. */
+inline size_t PackedBases::case_span(size_t i, bool &is_lower) const
+{
+    size_t r = std::upper_bound(lower.begin(), lower.end(), i,
+        [](size_t i, const CaseRun &r) { return i < r.offset + r.length; })
+        - lower.begin();
+    is_lower = r < lower.size() && lower[r].offset <= i;
+    if (is_lower) return lower[r].offset + lower[r].length - i;
+    return r < lower.size() ? lower[r].offset - i : size_t(-1);
+}
+
+/** return the base at offset i. */
+inline Base PackedBases::operator[](size_t i) const
+{
+    if (runs.size() > 0) {
+        size_t r = next_run(i);
+        if (r < runs.size() && runs[r].offset <= i) {
+            return Base(runs[r].symbol);
+        }
+    }
+    static const char sym[2][4] = { { 'A', 'C', 'G', 'T' },
+        { 'a', 'c', 'g', 't' } };
+    bool is_lower = false;
+    if (lower.size() > 0) case_span(i, is_lower);
+    return Base(sym[is_lower][(words[i >> 5] >> ((i & 31) << 1)) & 3]);
+}
+
+/** return 32 packed bases starting at any offset i. */
+inline uint64_t PackedBases::word_at(size_t i) const
+{
+    size_t w = i >> 5, s = (i & 31) << 1;
+    uint64_t v = words[w] >> s;
+    if (s) v |= words[w + 1] << (64 - s);
+    return v;
+}
+
+/**
+ * compare 32 bases per word, stopping short of runs of other symbols and
+ * of the first base whose case differs.
+ */
+static inline size_t match_length(const PackedBases &data, size_t a, size_t b,
+    size_t limit)
+{
+    /* other symbols only match as literals, so clip limit to the runs */
+    if (data.runs.size() > 0) {
+        size_t ra = data.next_run(a), rb = data.next_run(b);
+        if (ra < data.runs.size()) {
+            limit = std::min(limit, std::max(data.runs[ra].offset, a) - a);
+        }
+        if (rb < data.runs.size()) {
+            limit = std::min(limit, std::max(data.runs[rb].offset, b) - b);
+        }
+    }
+
+    /* copies keep the exact symbols, so clip limit where the case differs */
+    if (data.lower.size() > 0) {
+        size_t k = 0;
+        while (k < limit) {
+            bool la, lb;
+            size_t sa = data.case_span(a + k, la);
+            size_t sb = data.case_span(b + k, lb);
+            if (la != lb) break;
+            k += std::min(std::min(sa, sb), limit - k);
+        }
+        limit = k;
+    }
+
+    size_t i = 0;
+    while (i < limit) {
+        uint64_t x = data.word_at(a + i) ^ data.word_at(b + i);
+        if (x) {
+            i += __builtin_ctzll(x) >> 1;
+            break;
+        }
+        i += 32;
+    }
+    return std::min(i, limit);
+}
+
+/** nucleotides use packed storage. */
+template <>
+struct MatcherStorage<Base>
+{
+    typedef PackedBases type;
+};
+
+/** nucleotide hash is the packed k-mer ending at the current symbol. */
+template <typename Size>
+struct MatcherHash<Base,Size,false>
+{
+    static Size add(Size hval, Base symbol)
+    {
+        int code = base_code(char(symbol));
+        return (hval << 2) | Size(code < 0 ? 0 : code);
+    }
+};
@@ -0,0 +1,124 @@
+/*
+ * Pipeline
+ *
+ * Bounded queue and chunked stream format for pipelined matching.
+ *
+ * Copyright (c) 2020, Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <utility>
+
+#include "matcher.h"
+#include "encoding.h"
+
+/**
+ * bounded single producer single consumer queue.
+ *
+ * A power of two ring indexed by free running head and tail counters.
+ * The producer only stores tail and the consumer only stores head, so
+ * neither side takes a lock. A full or empty queue is waited out by
+ * yielding, as the stages it connects run for much longer than a slot.
+ */
+template <typename T>
+struct SpscQueue
+{
+    Vector<T> slots;
+    size_t mask;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+
+    SpscQueue(size_t capacity) : slots(), mask(0), head(0), tail(0)
+    {
+        size_t n = 1;
+        while (n < capacity) n <<= 1;
+        slots.resize(n);
+        mask = n - 1;
+    }
+
+    bool try_push(T &v)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) > mask) return false;
+        slots[t & mask] = std::move(v);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T &v)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        v = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    void push(T v) { while (!try_push(v)) std::this_thread::yield(); }
+    void pop(T &v) { while (!try_pop(v)) std::this_thread::yield(); }
+};
+
+/**
+ * instructions for one chunk of a stream.
+ *
+ * A chunk is written as a frame of a little-endian 32-bit length, then
+ * the instructions from encode_matches, then the literal symbols of the
+ * chunk in order. Copies may refer back into earlier chunks.
+ */
+template <typename Size = uint32_t>
+struct StreamChunk
+{
+    size_t base;
+    Vector<Match<Size>> matches;
+    Vector<uint8_t> literals;
+
+    StreamChunk() : base(0), matches(), literals() {}
+};
+
+/** write a chunk frame, false on error. */
+template <typename Size>
+bool write_chunk(FILE *f, const StreamChunk<Size> &c, Vector<uint8_t> &buf)
+{
+    buf.clear();
+    encode_matches(c.matches, 0, c.matches.size(), c.base, buf);
+    buf.insert(buf.end(), c.literals.begin(), c.literals.end());
+    uint8_t hdr[4] = { uint8_t(buf.size()), uint8_t(buf.size() >> 8),
+        uint8_t(buf.size() >> 16), uint8_t(buf.size() >> 24) };
+    return fwrite(hdr, 4, 1, f) == 1 &&
+        fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+}
+
+/** decode a stream of at most limit symbols, false if it is malformed. */
+static inline bool decode_stream(FILE *f, size_t limit, Vector<char> &out)
+{
+    uint8_t hdr[4];
+    Vector<uint8_t> buf;
+    while (fread(hdr, 4, 1, f) == 1) {
+        size_t length = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) |
+            (size_t(hdr[3]) << 24);
+        buf.resize(length);
+        if (fread(buf.data(), 1, length, f) != length ||
+            !decode_payload(buf.data(), buf.data() + length, limit, out)) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,250 @@
+/*
+ * Rsync
+ *
+ * Block signatures and deltas using the rsync algorithm.
+ *
+ * Copyright (c) 2020, Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+
+#include "matcher.h"
+#include "encoding.h"
+
+/** rsync weak checksum that rolls one byte at a time. */
+struct RollingChecksum
+{
+    uint32_t a, b;
+    size_t n;
+
+    RollingChecksum() : a(0), b(0), n(0) {}
+
+    void init(const uint8_t *src, size_t length)
+    {
+        a = b = 0;
+        n = length;
+        for (size_t i = 0; i < length; i++) {
+            a += src[i];
+            b += uint32_t(length - i) * src[i];
+        }
+    }
+
+    void roll(uint8_t out, uint8_t in)
+    {
+        a += in - out;
+        b += a - uint32_t(n) * out;
+    }
+
+    uint32_t value() const { return (a & 0xffff) | (b << 16); }
+};
+
+/** 128-bit strong block hash made from two independently seeded lanes. */
+struct StrongHash
+{
+    uint64_t h[2];
+
+    bool operator==(const StrongHash &o) const
+    {
+        return h[0] == o.h[0] && h[1] == o.h[1];
+    }
+
+    static StrongHash compute(const uint8_t *src, size_t length)
+    {
+        StrongHash s = {{ 0x243f6a8885a308d3ull ^ length,
+                          0x13198a2e03707344ull ^ length }};
+        size_t i = 0;
+        for (; i + 8 <= length; i += 8) {
+            uint64_t v = get_u64(src + i);
+            s.h[0] = hash_mix(s.h[0] ^ v);
+            s.h[1] = hash_mix(s.h[1] + v) * 0x9e3779b97f4a7c15ull;
+        }
+        uint64_t v = 0;
+        for (size_t j = i; j < length; j++) {
+            v |= uint64_t(src[j]) << ((j - i) * 8);
+        }
+        s.h[0] = hash_mix(s.h[0] ^ v);
+        s.h[1] = hash_mix(s.h[1] + v);
+        return s;
+    }
+};
+
+/**
+ * block signature of a file.
+ *
+ * The file holding the old version is split into fixed size blocks and
+ * each block is described by a weak rolling checksum and a strong hash.
+ * The host with the new version slides the rolling checksum over it and
+ * confirms weak hits with the strong hash to produce a delta.
+ */
+struct BlockSignature
+{
+    static const uint32_t kMagic = 0x4749534d; /* "MSIG" */
+
+    size_t block_size;
+    uint64_t length;
+    Vector<uint32_t> weak;
+    Vector<StrongHash> strong;
+
+    BlockSignature(size_t block_size = 2048) : block_size(block_size),
+        length(0), weak(), strong() {}
+
+    void compute(const uint8_t *src, size_t length);
+    bool write(FILE *f) const;
+    bool read(FILE *f);
+
+    template <typename Size>
+    void delta(const uint8_t *src, size_t length,
+        Vector<Match<Size>> &matches) const;
+};
+
+/** compute weak and strong checksums for each block. */
+inline void BlockSignature::compute(const uint8_t *src, size_t length)
+{
+    this->length = length;
+    weak.clear();
+    strong.clear();
+    for (size_t i = 0; i < length; i += block_size) {
+        size_t n = std::min(block_size, length - i);
+        RollingChecksum rc;
+        rc.init(src + i, n);
+        weak.push_back(rc.value());
+        strong.push_back(StrongHash::compute(src + i, n));
+    }
+}
+
+/**
+ * write the signature as little-endian binary.
+ *
+ * - header: magic, block size (32-bit), length, block count (64-bit)
+ * - blocks: weak checksum (32-bit), strong hash (2 x 64-bit)
+ */
+inline bool BlockSignature::write(FILE *f) const
+{
+    Vector<uint8_t> buf;
+    put_u32(buf, kMagic);
+    put_u32(buf, uint32_t(block_size));
+    put_u64(buf, length);
+    put_u64(buf, weak.size());
+    for (size_t i = 0; i < weak.size(); i++) {
+        put_u32(buf, weak[i]);
+        put_u64(buf, strong[i].h[0]);
+        put_u64(buf, strong[i].h[1]);
+    }
+    return fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+}
+
+/** read a signature written by write. */
+inline bool BlockSignature::read(FILE *f)
+{
+    uint8_t hdr[24], ent[20];
+    if (fread(hdr, sizeof(hdr), 1, f) != 1) return false;
+    uint32_t size = get_u32(hdr + 4);
+    uint64_t count = get_u64(hdr + 16);
+    length = get_u64(hdr + 8);
+    if (get_u32(hdr) != kMagic || size == 0 ||
+        count != (length + size - 1) / size) {
+        return false;
+    }
+    block_size = size;
+    weak.clear();
+    strong.clear();
+    for (size_t i = 0; i < count; i++) {
+        if (fread(ent, sizeof(ent), 1, f) != 1) return false;
+        weak.push_back(get_u32(ent));
+        strong.push_back({{ get_u64(ent + 4), get_u64(ent + 12) }});
+    }
+    return true;
+}
+
+/**
+ * compute the delta of new data against the signature.
+ *
+ * - Match[type=Literal] - new data at offset in the new file.
+ * - Match[type=Copy] - blocks at offset in the old file.
+ */
+template <typename Size>
+void BlockSignature::delta(const uint8_t *src, size_t length,
+    Vector<Match<Size>> &matches) const
+{
+    /* open addressing table from weak checksum to block number + 1 */
+    size_t slots = 16;
+    while (slots < weak.size() * 2) slots <<= 1;
+    Vector<uint32_t> table(slots);
+    for (uint32_t i = 0; i < weak.size(); i++) {
+        size_t j = hash_mix(weak[i]) & (slots - 1);
+        while (table[j]) j = (j + 1) & (slots - 1);
+        table[j] = i + 1;
+    }
+
+    auto find = [&](uint32_t w, const uint8_t *p, size_t n) -> size_t {
+        bool strong_done = false;
+        StrongHash s;
+        for (size_t j = hash_mix(w) & (slots - 1); table[j];
+            j = (j + 1) & (slots - 1))
+        {
+            size_t b = table[j] - 1;
+            size_t bn = std::min(block_size,
+                size_t(this->length - b * block_size));
+            if (weak[b] != w || bn != n) continue;
+            if (!strong_done) {
+                s = StrongHash::compute(p, n);
+                strong_done = true;
+            }
+            if (strong[b] == s) return b + 1;
+        }
+        return 0;
+    };
+
+    auto push = [&](MatchType type, size_t offset, size_t n) {
+        if (n == 0) return;
+        if (matches.size() > 0 && matches.back().type == type &&
+            matches.back().offset + matches.back().length == offset) {
+            matches.back().length += n;
+        } else {
+            matches.push_back({ type, Size(offset), Size(n) });
+        }
+    };
+
+    size_t pos = 0, lit = 0;
+    RollingChecksum rc;
+    bool rolling = false;
+    while (pos < length) {
+        size_t n = std::min(block_size, length - pos);
+        if (!rolling) {
+            rc.init(src + pos, n);
+            rolling = true;
+        }
+        size_t b = find(rc.value(), src + pos, n);
+        if (b) {
+            push(MatchType::Literal, lit, pos - lit);
+            push(MatchType::Copy, (b - 1) * block_size, n);
+            pos += n;
+            lit = pos;
+            rolling = false;
+        } else if (pos + n < length) {
+            rc.roll(src[pos], src[pos + n]);
+            pos++;
+        } else {
+            /* shrink the window at the end to find a short last block */
+            rc.init(src + pos + 1, n - 1);
+            pos++;
+        }
+    }
+    push(MatchType::Literal, lit, length - lit);
+}
@@ -0,0 +1,120 @@
+/*
+ * Scheduler
+ *
+ * Work stealing thread pool.
+ *
+ * Copyright (c) 2020, Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+
+#include "matcher.h"
+
+/**
+ * work stealing thread pool.
+ *
+ * Each worker has its own deque of tasks. A worker takes its newest task
+ * from the back, and once its deque is empty steals the oldest task from
+ * the front of another, which tends to be the largest piece of work left.
+ * Tasks are passed the index of the worker running them, so they can use
+ * per worker state and push subtasks onto their own deque. run returns
+ * once every task and subtask has finished.
+ */
+struct TaskPool
+{
+    typedef std::function<void(size_t)> Task;
+
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    Vector<std::unique_ptr<Queue>> queues;
+    std::atomic<size_t> pending;
+    std::atomic<size_t> steals;
+
+    TaskPool(size_t threads) : queues(), pending(0), steals(0)
+    {
+        for (size_t i = 0; i < std::max(threads, size_t(1)); i++) {
+            queues.emplace_back(new Queue());
+        }
+    }
+
+    size_t size() const { return queues.size(); }
+
+    void push(size_t worker, Task task);
+    bool next(size_t worker, Task &task);
+    void run();
+};
+
+/** add a task to the deque of a worker. */
+inline void TaskPool::push(size_t worker, Task task)
+{
+    pending++;
+    Queue &q = *queues[worker % queues.size()];
+    std::unique_lock<std::mutex> l(q.lock);
+    q.tasks.push_back(std::move(task));
+}
+
+/** take a task from our own deque or steal one from another. */
+inline bool TaskPool::next(size_t worker, Task &task)
+{
+    for (size_t i = 0; i < queues.size(); i++) {
+        size_t v = (worker + i) % queues.size();
+        Queue &q = *queues[v];
+        std::unique_lock<std::mutex> l(q.lock);
+        if (q.tasks.empty()) continue;
+        if (v == worker) {
+            task = std::move(q.tasks.back());
+            q.tasks.pop_back();
+        } else {
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            steals++;
+        }
+        return true;
+    }
+    return false;
+}
+
+/** run tasks on all workers until none are left. */
+inline void TaskPool::run()
+{
+    auto worker = [this](size_t w) {
+        Task task;
+        while (pending > 0) {
+            if (next(w, task)) {
+                task(w);
+                task = nullptr;
+                pending--;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t w = 1; w < queues.size(); w++) pool.emplace_back(worker, w);
+    worker(0);
+    for (auto &t : pool) t.join();
+}
@@ -0,0 +1,226 @@
+/*
+ * Server
+ *
+ * Local match service over a Unix domain socket.
+ *
+ * Copyright (c) 2020, Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "matcher.h"
+#include "encoding.h"
+
+/** write all of buf to a socket, false on error. */
+static inline bool write_all(int fd, const void *buf, size_t length)
+{
+    const char *p = (const char*)buf;
+    while (length > 0) {
+        ssize_t n = send(fd, p, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+
+/** read exactly length bytes from a socket, false on error or close. */
+static inline bool read_all(int fd, void *buf, size_t length)
+{
+    char *p = (char*)buf;
+    while (length > 0) {
+        ssize_t n = recv(fd, p, length, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+
+/** write a frame of a little-endian 32-bit length and its payload. */
+static inline bool write_frame(int fd, const uint8_t *buf, size_t length)
+{
+    uint8_t hdr[4] = { uint8_t(length), uint8_t(length >> 8),
+        uint8_t(length >> 16), uint8_t(length >> 24) };
+    return length <= 0xffffffffu && write_all(fd, hdr, 4) &&
+        write_all(fd, buf, length);
+}
+
+/** read a frame written by write_frame, false on error or close. */
+static inline bool read_frame(int fd, Vector<uint8_t> &buf,
+    size_t max_length = 1u << 30)
+{
+    uint8_t hdr[4];
+    if (!read_all(fd, hdr, 4)) return false;
+    size_t length = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) |
+        (size_t(hdr[3]) << 24);
+    if (length > max_length) return false;
+    buf.resize(length);
+    return read_all(fd, buf.data(), length);
+}
+
+/** fill in a Unix domain socket address, false if the path is too long. */
+static inline bool unix_address(const char *path, struct sockaddr_un &addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) return false;
+    strcpy(addr.sun_path, path);
+    return true;
+}
+
+/** connect to a match server, returning the socket or -1. */
+static inline int connect_unix(const char *path)
+{
+    struct sockaddr_un addr;
+    if (!unix_address(path, addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * local match server.
+ *
+ * Each worker thread holds a warm matcher set up once by the init
+ * callback, which may prime it with references. Accepted connections are
+ * queued and each is served by one worker until it closes, so the frames
+ * of a connection are answered in order while connections are spread
+ * across workers. A request frame holds the symbols, and its response
+ * frame holds the instructions from encode_matches. Between requests the
+ * matcher is rewound to the end of the references, so a request costs
+ * its decomposition and no allocation once buffers have grown.
+ */
+template <typename Symbol = char, typename Size = uint32_t>
+struct MatchServer
+{
+    size_t threads;
+    int listen_fd;
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<int> pending;
+
+    MatchServer(size_t threads) : threads(threads), listen_fd(-1),
+        lock(), ready(), pending() {}
+    ~MatchServer() { if (listen_fd >= 0) close(listen_fd); }
+
+    bool listen(const char *path);
+
+    template <typename Init>
+    void run(Init init);
+
+    template <typename Init>
+    void worker(Init init);
+};
+
+/** bind the socket path, replacing a stale socket left behind. */
+template <typename Symbol, typename Size>
+bool MatchServer<Symbol,Size>::listen(const char *path)
+{
+    struct sockaddr_un addr;
+    struct stat statbuf;
+    if (!unix_address(path, addr)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    if (lstat(path, &statbuf) == 0 && S_ISSOCK(statbuf.st_mode)) {
+        unlink(path);
+    }
+    if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) return false;
+    return bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == 0 &&
+        ::listen(listen_fd, 64) == 0;
+}
+
+/** accept connections forever, handing them to the workers. */
+template <typename Symbol, typename Size>
+template <typename Init>
+void MatchServer<Symbol,Size>::run(Init init)
+{
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; t++) {
+        pool.emplace_back([this, init]() { worker(init); });
+    }
+    for (;;) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        std::unique_lock<std::mutex> l(lock);
+        pending.push_back(fd);
+        ready.notify_one();
+    }
+
+    /* a closed listener stops the workers once the queue drains */
+    {
+        std::unique_lock<std::mutex> l(lock);
+        pending.push_back(-1);
+        ready.notify_all();
+    }
+    for (auto &t : pool) t.join();
+}
+
+/** answer request frames on queued connections with a warm matcher. */
+template <typename Symbol, typename Size>
+template <typename Init>
+void MatchServer<Symbol,Size>::worker(Init init)
+{
+    Matcher<Symbol,Size> m;
+    init(m);
+    size_t base = m.mark;
+    Vector<Size> saved_head(m.head);
+    Vector<uint8_t> req, resp;
+
+    for (;;) {
+        int fd;
+        {
+            std::unique_lock<std::mutex> l(lock);
+            ready.wait(l, [this]() { return pending.size() > 0; });
+            fd = pending.front();
+            if (fd < 0) return;
+            pending.pop_front();
+        }
+        while (read_frame(fd, req)) {
+            const Symbol *p = (const Symbol*)req.data();
+            m.rewind(base, saved_head);
+            m.append(p, p + req.size() / sizeof(Symbol));
+            m.decompose(false);
+            resp.clear();
+            encode_matches(m.matches, 0, m.matches.size(), base, resp);
+            if (!write_frame(fd, resp.data(), resp.size())) break;
+        }
+        close(fd);
+    }
+}
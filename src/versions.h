@@ -0,0 +1,129 @@
+/*
+ * Versions
+ *
+ * Versioned document store with a sliding window of history.
+ *
+ * Copyright (c) 2020, Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include "matcher.h"
+
+/**
+ * versioned document store.
+ *
+ * Each version is appended and decomposed against the retained history,
+ * starting with a zero length literal that marks the version boundary.
+ * Once the history would exceed twice max_size the oldest versions are
+ * evicted by sliding the matcher until it is back within max_size. A
+ * slide rewrites the instructions and rebuilds the index, so evicting in
+ * batches of max_size keeps memory bounded by twice the window while
+ * amortizing that cost over the data appended between slides.
+ */
+template <typename Symbol = char, typename Size = uint32_t>
+struct VersionStore
+{
+    Matcher<Symbol,Size> m;
+    size_t max_size;
+    size_t first;               /* id of the oldest retained version */
+    Vector<size_t> offset;      /* data offset of each retained version */
+    Vector<size_t> index;       /* first instruction of each version */
+
+    VersionStore(size_t max_size, size_t hash_bits = 16) : m(hash_bits),
+        max_size(max_size), first(0), offset(), index() {}
+
+    size_t count() const { return first + offset.size(); }
+    bool retained(size_t version) const
+    {
+        return version >= first && version < count();
+    }
+
+    template <typename Iterator>
+    size_t commit(Iterator begin, Iterator end);
+    void evict(size_t versions);
+    bool get(size_t version, Vector<Symbol> &out) const;
+};
+
+/** add a version, returning its id, and evict versions past the window. */
+template <typename Symbol, typename Size>
+template <typename Iterator>
+size_t VersionStore<Symbol,Size>::commit(Iterator begin, Iterator end)
+{
+    /* evict first so that the new version only copies retained data */
+    size_t length = std::distance(begin, end), n = 0;
+    if (m.data.size() + length > max_size * 2) {
+        while (n < offset.size() &&
+            m.data.size() + length - offset[n] > max_size) {
+            n++;
+        }
+        evict(n);
+    }
+
+    offset.push_back(m.data.size());
+    index.push_back(m.matches.size());
+    m.append(begin, end);
+    m.decompose(true);
+
+    return count() - 1;
+}
+
+/** evict the oldest versions. */
+template <typename Symbol, typename Size>
+void VersionStore<Symbol,Size>::evict(size_t versions)
+{
+    if (versions == 0) return;
+    assert(versions <= offset.size());
+
+    size_t n = versions < offset.size() ? offset[versions] : m.data.size();
+    m.slide(n);
+
+    /* slide may split copies, so find version starts again by position */
+    offset.erase(offset.begin(), offset.begin() + versions);
+    for (auto &o : offset) o -= n;
+    index.clear();
+    size_t pos = 0;
+    for (size_t i = 0; i < m.matches.size(); i++) {
+        while (index.size() < offset.size() && offset[index.size()] == pos) {
+            index.push_back(i);
+        }
+        pos += m.matches[i].length;
+    }
+    while (index.size() < offset.size()) index.push_back(m.matches.size());
+    first += versions;
+}
+
+/** reconstruct a retained version by decoding its history. */
+template <typename Symbol, typename Size>
+bool VersionStore<Symbol,Size>::get(size_t version, Vector<Symbol> &out) const
+{
+    if (!retained(version)) return false;
+
+    /*
+     * Copies refer back into earlier retained versions, so decode from
+     * the start of the window up to the end of the version.
+     */
+    size_t v = version - first;
+    size_t end = v + 1 < index.size() ? index[v + 1] : m.matches.size();
+    Vector<Match<Size>> edits(m.matches.begin(), m.matches.begin() + end);
+    Vector<Symbol> all;
+    decode(edits, m.data, all);
+    out.assign(all.begin() + offset[v], all.end());
+    return true;
+}